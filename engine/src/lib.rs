@@ -29,6 +29,7 @@ pub struct Engine {
     transposition_table: tt::TranspositionTable,
     tablebase: Option<fathom::Tablebase>,
     options: opts::Opts,
+    debug: bool,
 }
 
 impl Default for Engine {
@@ -39,6 +40,7 @@ impl Default for Engine {
             transposition_table,
             tablebase: None,
             options,
+            debug: false,
         }
     }
 }
@@ -115,6 +117,9 @@ impl Engine {
                     )
                     .best_move();
 
+                    if self.debug {
+                        self.print_tablebase_stats();
+                    }
                     println!("bestmove {bm}");
 
                     if do_agg {
@@ -124,7 +129,12 @@ impl Engine {
                 }
                 uci::Command::Unknown(e) => tracing::warn!("{e}"),
                 uci::Command::PonderHit => todo!(),
-                uci::Command::Debug => todo!(),
+                uci::Command::Debug(on) => {
+                    self.debug = on;
+                    if let Some(tablebase) = self.tablebase.as_ref() {
+                        tablebase.set_stats_enabled(on);
+                    }
+                }
             }
         }
 
@@ -150,14 +160,74 @@ impl Engine {
                     .clone()
                     .expect("should be set at this point");
                 tracing::info!("loading tablebase from path: {path:?}");
-                self.tablebase = Some({
-                    let ownership = fathom::Tablebase::acquire()
-                        .expect("Nothing else should doing tablebase stuff at this point in time");
-                    fathom::Tablebase::load(ownership, path).map_err(|(err, _ownership)| err)?
-                });
+                // The previous tablebase (if any) is only dropped once the new one has loaded.
+                let mut tablebase = fathom::Tablebase::load(path)?;
+                tablebase.set_cache_size(self.options.syzygy_cache_mb * 1024 * 1024);
+                tablebase.set_stats_enabled(self.debug);
+                self.tablebase = Some(tablebase);
+                self.preload_tablebase();
+            }
+            "SyzygyPreload" | "SyzygyPreloadLimit" | "SyzygyPreloadLock" => {
+                self.preload_tablebase();
+            }
+            "SyzygyCache" => {
+                let value = self.options.syzygy_cache_mb;
+                tracing::info!("setting tablebase cache size to {} MB", value);
+                if let Some(tablebase) = self.tablebase.as_mut() {
+                    tablebase.set_cache_size(value * 1024 * 1024);
+                }
             }
             _ => {}
         }
         Ok(())
     }
+
+    /// Print the tablebase probe statistics as `info string` lines, one for each table used.
+    fn print_tablebase_stats(&self) {
+        let Some(tablebase) = self.tablebase.as_ref() else {
+            return;
+        };
+        let stats = tablebase.stats();
+        println!(
+            "info string tablebase wdl {} probes {} failed root {} probes {} failed",
+            stats.wdl_probes, stats.wdl_failures, stats.root_probes, stats.root_failures
+        );
+        let fmt_file = |file: &fathom::FileStats| {
+            format!(
+                "{} probes {} blocks {} bytes init {}",
+                file.probes,
+                file.blocks,
+                file.bytes,
+                file.init_time
+                    .map_or_else(|| "-".to_string(), |t| format!("{}us", t.as_micros()))
+            )
+        };
+        for table in &stats.tables {
+            println!(
+                "info string tablebase {} wdl {} dtz {}",
+                table.name,
+                fmt_file(&table.wdl),
+                fmt_file(&table.dtz)
+            );
+        }
+    }
+
+    /// Read the tablebase into memory, if enabled by the options.
+    ///
+    /// Tables locked by an earlier preload are unlocked when preloading or locking is disabled.
+    fn preload_tablebase(&mut self) {
+        let Some(tablebase) = self.tablebase.as_mut() else {
+            return;
+        };
+        if !self.options.syzygy_preload || !self.options.syzygy_preload_lock {
+            tablebase.unlock();
+        }
+        if !self.options.syzygy_preload {
+            return;
+        }
+        let limit = self.options.syzygy_preload_limit_mb;
+        let budget = (limit > 0).then_some(limit * 1024 * 1024);
+        let loaded = tablebase.preload(budget, self.options.syzygy_preload_lock);
+        tracing::info!("preloaded {} MB of tablebase files", loaded / (1024 * 1024));
+    }
 }
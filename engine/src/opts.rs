@@ -17,6 +17,36 @@ pub struct Opts {
     pub hash_size_mb: usize,
     #[uci(name = "SyzygyPath", kind = "string")]
     pub syzygy_path: Option<PathBuf>,
+    #[uci(
+        name = "SyzygyCache",
+        kind = "spin",
+        default = "16",
+        min = "0",
+        max = "65536"
+    )]
+    pub syzygy_cache_mb: usize,
+    #[uci(name = "SyzygyPreload", kind = "check", default = "false")]
+    pub syzygy_preload: bool,
+    /// Memory limit for preloading tables in MB, or zero for no limit.
+    #[uci(
+        name = "SyzygyPreloadLimit",
+        kind = "spin",
+        default = "0",
+        min = "0",
+        max = "33554432"
+    )]
+    pub syzygy_preload_limit_mb: usize,
+    #[uci(name = "SyzygyPreloadLock", kind = "check", default = "false")]
+    pub syzygy_preload_lock: bool,
+    /// Threads to probe the root moves with when the root position is in the tablebase.
+    #[uci(
+        name = "SyzygyRootThreads",
+        kind = "spin",
+        default = "1",
+        min = "1",
+        max = "64"
+    )]
+    pub syzygy_root_threads: usize,
     #[uci(name = "Threads", kind = "spin", min = "1", max = "1", default = "1")]
     pub threads: usize,
 
@@ -1,9 +1,11 @@
 use chess::{Board, ChessMove};
+use fathom::Wdl;
 
 use super::stackstate::StackState;
 use super::Searcher;
 use crate::board::BoardExt;
 use crate::newtypes::{Depth, Ply, Value};
+use crate::opts::OPTS;
 use crate::tt;
 
 impl Searcher<'_> {
@@ -141,12 +143,23 @@ impl Searcher<'_> {
     ///
     /// A tablebase must be initialized, and the root position must be in the tablebase.
     pub fn filter_root_moves_using_tb(&mut self) {
+        let Some(tb) = self.tablebase else {
+            return;
+        };
+        let board = self.root_position;
         let hmc = self.stack_state(Ply::ZERO).halfmove_clock;
 
-        if let Some((wdl, filter)) = self
-            .tablebase
-            .and_then(|tb| tb.probe_dtz(&self.root_position, hmc))
-        {
+        let threads = OPTS.syzygy_root_threads;
+        if threads > 1 {
+            self.apply_root_tb_filter(tb.probe_dtz_parallel(&board, hmc, threads));
+        } else {
+            self.apply_root_tb_filter(tb.probe_dtz(&board, hmc));
+        }
+    }
+
+    /// Keep only the root moves accepted by the filter of a root probe.
+    fn apply_root_tb_filter(&mut self, probe: Option<(Wdl, impl Fn(&ChessMove) -> bool)>) {
+        if let Some((wdl, filter)) = probe {
             self.logger.tb_hit();
             self.root_moves.retain(|r| filter(&r.mv));
 
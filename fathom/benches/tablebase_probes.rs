@@ -0,0 +1,205 @@
+//! Benchmarks for probing the bundled Syzygy tables (see `syzygy/README.md` for how to get them).
+//!
+//! Run with `cargo bench -p fathom`. Throughput is reported per probed position, so the time per
+//! element is the time per probe.
+use std::path::Path;
+use std::str::FromStr;
+use std::time::{Duration, Instant};
+
+use chess::Board;
+use criterion::{BatchSize, BenchmarkId, Criterion, Throughput, criterion_group, criterion_main};
+
+use fathom::Tablebase;
+
+const SYZYGY_PATH: &str = concat!(env!("CARGO_MANIFEST_DIR"), "/../syzygy");
+
+/// A fixed set of 3-5 man positions, none of which have castling rights.
+const POSITIONS: &[&str] = &[
+    "8/8/8/4k3/8/8/4P3/4K3 w - - 0 1",
+    "8/8/8/8/3k4/8/8/R3K3 b - - 0 1",
+    "8/8/4k3/8/8/2q5/8/3QK3 w - - 0 1",
+    "4k3/8/8/8/8/8/4p3/R3K3 w - - 0 1",
+    "K7/2kB4/8/8/8/8/8/5N2 w - - 0 1",
+    "8/3k4/8/8/8/4B3/4KB2/2B5 w - - 0 1",
+    "8/6B1/8/8/B7/8/K1pk4/8 b - - 0 1",
+    "8/8/8/5N2/8/p7/8/2NK3k w - - 0 1",
+    "8/8/8/8/5kp1/P7/8/1K1N4 w - - 0 1",
+    "8/8/8/k1pPp3/8/K7/8/8 w - e6 0 1",
+    "k7/7p/8/8/8/8/1NN5/7K w - - 0 1",
+];
+
+fn boards() -> Vec<Board> {
+    POSITIONS
+        .iter()
+        .map(|fen| Board::from_str(fen).expect("benchmark positions should be valid"))
+        .collect()
+}
+
+fn load() -> Tablebase {
+    Tablebase::load(SYZYGY_PATH).expect("the 5-man tables should be in syzygy/")
+}
+
+fn elements(count: usize) -> Throughput {
+    Throughput::Elements(count as u64)
+}
+
+/// Drop the table files from the page cache, so that the next load reads them from disk.
+///
+/// Pages that are still mapped are not dropped, so this must be called with no tablebase loaded.
+#[cfg(target_os = "linux")]
+fn evict_page_cache(path: &Path) {
+    use std::os::fd::AsRawFd;
+
+    for entry in std::fs::read_dir(path).expect("syzygy path should be readable") {
+        let path = entry.expect("syzygy path should be readable").path();
+        if !path
+            .extension()
+            .is_some_and(|ext| ext == "rtbw" || ext == "rtbz")
+        {
+            continue;
+        }
+        let file = std::fs::File::open(&path).expect("table files should be readable");
+        // Safety: The descriptor is valid for the lifetime of `file`.
+        unsafe { libc::posix_fadvise(file.as_raw_fd(), 0, 0, libc::POSIX_FADV_DONTNEED) };
+    }
+}
+
+/// Probes with every table already resident in memory.
+fn warm(c: &mut Criterion) {
+    let boards = boards();
+    let mut tb = load();
+    for board in &boards {
+        let _ = tb.probe_wdl(board, 0);
+        let _ = tb.probe_dtz(board, 0);
+    }
+
+    let mut group = c.benchmark_group("warm");
+    group.throughput(elements(boards.len()));
+    group.bench_function("wdl", |b| {
+        b.iter(|| {
+            for board in &boards {
+                std::hint::black_box(tb.probe_wdl(board, 0));
+            }
+        });
+    });
+    group.bench_function("wdl_batch", |b| {
+        b.iter(|| std::hint::black_box(tb.probe_wdl_many(&boards)));
+    });
+    group.bench_function("dtz_root", |b| {
+        b.iter(|| {
+            for board in &boards {
+                std::hint::black_box(tb.probe_dtz(board, 0).map(|(wdl, _)| wdl));
+            }
+        });
+    });
+
+    tb.set_cache_size(16 * 1024 * 1024);
+    group.bench_function("wdl_cached", |b| {
+        b.iter(|| {
+            for board in &boards {
+                std::hint::black_box(tb.probe_wdl(board, 0));
+            }
+        });
+    });
+    group.finish();
+}
+
+/// Probes on a freshly loaded tablebase whose files have been dropped from the page cache, as
+/// after a reboot. This includes the time to initialize each table on its first probe.
+#[cfg(target_os = "linux")]
+fn cold(c: &mut Criterion) {
+    let boards = boards();
+    let path = Path::new(SYZYGY_PATH);
+
+    let mut group = c.benchmark_group("cold");
+    group.throughput(elements(boards.len()));
+    group.sample_size(10);
+    let setup = || {
+        evict_page_cache(path);
+        load()
+    };
+    group.bench_function("wdl", |b| {
+        b.iter_batched(
+            setup,
+            |tb| {
+                for board in &boards {
+                    std::hint::black_box(tb.probe_wdl(board, 0));
+                }
+                tb
+            },
+            BatchSize::PerIteration,
+        );
+    });
+    group.bench_function("wdl_batch", |b| {
+        b.iter_batched(
+            setup,
+            |tb| {
+                std::hint::black_box(tb.probe_wdl_many(&boards));
+                tb
+            },
+            BatchSize::PerIteration,
+        );
+    });
+    group.bench_function("dtz_root", |b| {
+        b.iter_batched(
+            setup,
+            |tb| {
+                for board in &boards {
+                    std::hint::black_box(tb.probe_dtz(board, 0).map(|(wdl, _)| wdl));
+                }
+                tb
+            },
+            BatchSize::PerIteration,
+        );
+    });
+    group.finish();
+}
+
+#[cfg(not(target_os = "linux"))]
+fn cold(_: &mut Criterion) {}
+
+/// WDL probes from several threads sharing one warm tablebase, with the result cache disabled.
+///
+/// Throughput is the total over all threads, i.e. probes per second for the whole machine.
+fn threads(c: &mut Criterion) {
+    let boards = boards();
+    let tb = load();
+    for board in &boards {
+        let _ = tb.probe_wdl(board, 0);
+    }
+
+    let max_threads = std::thread::available_parallelism().map_or(1, std::num::NonZero::get);
+    let mut thread_counts = vec![1, 2, 4, 8, max_threads];
+    thread_counts.retain(|&n| n <= max_threads);
+    thread_counts.dedup();
+
+    let mut group = c.benchmark_group("threads");
+    for n in thread_counts {
+        group.throughput(elements(boards.len() * n));
+        group.bench_with_input(BenchmarkId::new("wdl", n), &n, |b, &n| {
+            b.iter_custom(|iters| {
+                let start = Instant::now();
+                std::thread::scope(|s| {
+                    for _ in 0..n {
+                        s.spawn(|| {
+                            for _ in 0..iters {
+                                for board in &boards {
+                                    std::hint::black_box(tb.probe_wdl(board, 0));
+                                }
+                            }
+                        });
+                    }
+                });
+                start.elapsed()
+            });
+        });
+    }
+    group.finish();
+}
+
+criterion_group! {
+    name = benches;
+    config = Criterion::default().measurement_time(Duration::from_secs(5));
+    targets = warm, cold, threads
+}
+criterion_main!(benches);
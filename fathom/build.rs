@@ -1,9 +1,17 @@
 fn main() {
-    cc::Build::new()
+    let mut build = cc::Build::new();
+    build
         .include("external/fathom/src")
         .file("external/fathom/src/tbprobe.c")
         .flag("-DTB_NO_HELPER_API")
-        .flag_if_supported("-TP")
-        .compile("fathom");
+        .flag_if_supported("-TP");
+
+    // Use PEXT slider attacks when the target has BMI2, e.g. with `-C target-cpu=native`.
+    let target_features = std::env::var("CARGO_CFG_TARGET_FEATURE").unwrap_or_default();
+    if target_features.split(',').any(|feature| feature == "bmi2") {
+        build.define("TB_USE_PEXT", None).flag_if_supported("-mbmi2");
+    }
+
+    build.compile("fathom");
     println!("cargo:rerun-if-changed=external/fathom");
 }
@@ -24,9 +24,12 @@
 
 #include <assert.h>
 #include <getopt.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "tbprobe.h"
 
@@ -455,7 +458,7 @@ static void do_move(struct pos *pos, unsigned move)
 /*
  * Print the pseudo "PV" for the given position.
  */
-static void print_PV(struct pos *pos)
+static void print_PV(struct TbContext *ctx, struct pos *pos)
 {
     struct pos temp = *pos;
     putchar('\n');
@@ -467,7 +470,7 @@ static void print_PV(struct pos *pos)
     }
     while (true)
     {
-        unsigned move = tb_probe_root(pos->white, pos->black, pos->kings,
+        unsigned move = tb_probe_root(ctx, pos->white, pos->black, pos->kings,
             pos->queens, pos->rooks, pos->bishops, pos->knights, pos->pawns,
             pos->rule50, pos->castling, pos->ep, pos->turn, NULL);
         if (move == TB_RESULT_FAILED)
@@ -529,7 +532,8 @@ static bool print_moves(struct pos *pos, unsigned *results, bool prev,
 static void print_help(const char *prog)
 {
     printf("\n");
-    printf("usage: %s [--help] [--path=PATH] [--test] FEN\n\n", prog);
+    printf("usage: %s [--help] [--path=PATH] [--test] FEN\n", prog);
+    printf("       %s [--path=PATH] [--threads=N] --bulk[=FILE]\n\n", prog);
     printf("WHERE:\n");
     printf("\tFEN\n");
     printf("\t\tThe position (as a FEN string) to be probed.\n");
@@ -539,6 +543,10 @@ static void print_help(const char *prog)
     printf("\t\tSet the tablebase PATH string.\n");
     printf("\t--test\n");
     printf("\t\tPrint the result only.  Useful for scripts.\n");
+    printf("\t--bulk[=FILE]\n");
+    printf("\t\tProbe every FEN or EPD line of FILE (default stdin).\n");
+    printf("\t--threads=N\n");
+    printf("\t\tProbe on N threads in bulk mode (default 1).\n");
     printf("\n");
     printf("DESCRIPTION:\n");
     printf("\tThis program is a stand-alone Syzygy tablebase probe tool.  "
@@ -572,6 +580,203 @@ static void print_help(const char *prog)
         "shortest\n");
     printf("\tmate nor the most natural human moves.\n");
     printf("\n");
+    printf("\tIn bulk mode, one line is written for each input line, in "
+        "the same\n");
+    printf("\torder.  The line holds the input followed by tab-separated "
+        "fields:\n");
+    printf("\tthe Result, the WDL value, the DTZ value and the DTM value "
+        "(in plys,\n");
+    printf("\tnegative if losing), with \"-\" where a value is not "
+        "available.\n");
+    printf("\tThe Result is \"*\" if the line could not be probed.  "
+        "The throughput\n");
+    printf("\tis reported on stderr at the end.\n");
+    printf("\n");
+}
+
+/*
+ * Bulk mode: lines are read in batches, probed by all threads, and written
+ * in input order before the next batch is read.
+ */
+#define BULK_BATCH      4096
+#define BULK_LINE_MAX   256
+#define BULK_RECORD_MAX 64
+
+struct bulk_line
+{
+    char line[BULK_LINE_MAX];
+    char record[BULK_RECORD_MAX];
+    bool ok;
+};
+
+struct bulk
+{
+    struct TbContext *ctx;
+    struct bulk_line *lines;
+    size_t n;
+    atomic_size_t next;
+};
+
+/*
+ * Parse a FEN, or an EPD line (which has no move counters).
+ */
+static bool parse_line(struct pos *pos, const char *line)
+{
+    if (parse_FEN(pos, line))
+        return true;
+    char fen[BULK_LINE_MAX + 8];
+    size_t len = 0;
+    unsigned fields = 0;
+    while (fields < 4)
+    {
+        while (*line == ' ' || *line == '\t')
+            line++;
+        if (*line == '\0')
+            return false;
+        if (fields != 0)
+            fen[len++] = ' ';
+        while (*line != '\0' && *line != ' ' && *line != '\t')
+            fen[len++] = *line++;
+        fields++;
+    }
+    strcpy(fen + len, " 0 1");
+    return parse_FEN(pos, fen);
+}
+
+/*
+ * Probe one line into its record.
+ */
+static void bulk_probe(struct TbContext *ctx, struct bulk_line *bl)
+{
+    static const char *wdl_to_name_str[5] =
+    {
+        "Loss",
+        "BlessedLoss",
+        "Draw",
+        "CursedWin",
+        "Win"
+    };
+    struct pos pos0;
+    struct pos *pos = &pos0;
+    bl->ok = false;
+    strcpy(bl->record, "*\t-\t-\t-");
+    if (!parse_line(pos, bl->line) ||
+            tb_pop_count(pos->white | pos->black) > tb_context_largest(ctx))
+        return;
+    unsigned res = tb_probe_dtz(ctx, pos->white, pos->black, pos->kings,
+        pos->queens, pos->rooks, pos->bishops, pos->knights, pos->pawns,
+        pos->rule50, pos->castling, pos->ep, pos->turn);
+    if (res == TB_RESULT_FAILED)
+        return;
+    unsigned wdl = TB_GET_WDL(res), dtz = TB_GET_DTZ(res);
+    char dtm_str[16] = "-";
+    int dtm;
+    if (tb_probe_dtm(ctx, pos->white, pos->black, pos->kings, pos->queens,
+            pos->rooks, pos->bishops, pos->knights, pos->pawns,
+            pos->castling, pos->ep, pos->turn, &dtm))
+        snprintf(dtm_str, sizeof(dtm_str), "%d", dtm);
+    snprintf(bl->record, sizeof(bl->record), "%s\t%s\t%u\t%s",
+        wdl_to_str[(pos->turn? wdl: 4-wdl)], wdl_to_name_str[wdl], dtz,
+        dtm_str);
+    bl->ok = true;
+}
+
+static void *bulk_worker(void *arg)
+{
+    struct bulk *bulk = (struct bulk *)arg;
+    while (true)
+    {
+        size_t i = atomic_fetch_add(&bulk->next, 1);
+        if (i >= bulk->n)
+            break;
+        bulk_probe(bulk->ctx, &bulk->lines[i]);
+    }
+    return NULL;
+}
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * Read a line into buf, dropping the line ending and anything that does not
+ * fit.  Returns false at the end of the input.
+ */
+static bool read_line(FILE *in, char *buf, size_t size)
+{
+    if (fgets(buf, size, in) == NULL)
+        return false;
+    size_t len = strcspn(buf, "\r\n");
+    if (buf[len] == '\0')
+    {
+        int c;
+        while ((c = getc(in)) != EOF && c != '\n')
+            ;
+    }
+    buf[len] = '\0';
+    return true;
+}
+
+/*
+ * Probe all lines of the input, writing one record per line to stdout.
+ */
+static void run_bulk(struct TbContext *ctx, FILE *in, unsigned threads)
+{
+    struct bulk bulk;
+    bulk.ctx = ctx;
+    bulk.lines = (struct bulk_line *)malloc(BULK_BATCH *
+        sizeof(struct bulk_line));
+    pthread_t *workers = (pthread_t *)malloc(threads * sizeof(pthread_t));
+    if (bulk.lines == NULL || workers == NULL)
+    {
+        fprintf(stderr, "error: out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    size_t total = 0, failed = 0;
+    double start = now_seconds();
+    bool done = false;
+    while (!done)
+    {
+        bulk.n = 0;
+        while (bulk.n < BULK_BATCH)
+        {
+            if (!read_line(in, bulk.lines[bulk.n].line, BULK_LINE_MAX))
+            {
+                done = true;
+                break;
+            }
+            bulk.n++;
+        }
+        atomic_store(&bulk.next, 0);
+        for (unsigned i = 1; i < threads; i++)
+        {
+            if (pthread_create(&workers[i], NULL, bulk_worker, &bulk) != 0)
+            {
+                fprintf(stderr, "error: unable to create thread\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        bulk_worker(&bulk);
+        for (unsigned i = 1; i < threads; i++)
+            pthread_join(workers[i], NULL);
+        for (size_t i = 0; i < bulk.n; i++)
+        {
+            printf("%s\t%s\n", bulk.lines[i].line, bulk.lines[i].record);
+            failed += !bulk.lines[i].ok;
+        }
+        total += bulk.n;
+    }
+    fflush(stdout);
+    double elapsed = now_seconds() - start;
+    fprintf(stderr, "%zu positions (%zu failed) in %.3f s, %.0f "
+        "positions/s on %u thread%s\n", total, failed, elapsed,
+        (elapsed > 0? total / elapsed: 0.0), threads,
+        (threads == 1? "": "s"));
+    free(workers);
+    free(bulk.lines);
 }
 
 
@@ -581,6 +786,8 @@ static void print_help(const char *prog)
 #define OPTION_HELP     0
 #define OPTION_PATH     1
 #define OPTION_TEST     2
+#define OPTION_BULK     3
+#define OPTION_THREADS  4
 int main(int argc, char **argv)
 {
     static struct option long_options[] =
@@ -588,10 +795,15 @@ int main(int argc, char **argv)
         {"help", 0, 0, OPTION_HELP},
         {"path", 1, 0, OPTION_PATH},
         {"test", 0, 0, OPTION_TEST},
+        {"bulk", 2, 0, OPTION_BULK},
+        {"threads", 1, 0, OPTION_THREADS},
         {NULL, 0, 0, 0}
     };
     char *path = NULL;
     bool test = false;
+    bool bulk = false;
+    const char *bulk_file = NULL;
+    int threads = 1;
     while (true)
     {
         int idx;
@@ -608,6 +820,15 @@ int main(int argc, char **argv)
             case OPTION_TEST:
                 test = true;
                 break;
+            case OPTION_BULK:
+                bulk = true;
+                bulk_file = optarg;
+                break;
+            case OPTION_THREADS:
+                threads = atoi(optarg);
+                if (threads < 1)
+                    goto usage;
+                break;
             case OPTION_HELP:
             default:
             usage:
@@ -615,9 +836,19 @@ int main(int argc, char **argv)
                 return EXIT_SUCCESS;
         }
     }
-    if (optind != argc-1)
+    if (optind != argc-(bulk? 0: 1))
         goto usage;
     const char *fen = argv[optind];
+    FILE *in = stdin;
+    if (bulk_file != NULL && strcmp(bulk_file, "-") != 0)
+    {
+        in = fopen(bulk_file, "r");
+        if (in == NULL)
+        {
+            fprintf(stderr, "error: unable to open \"%s\"\n", bulk_file);
+            exit(EXIT_FAILURE);
+        }
+    }
 
     // (0) init:
     if (path == NULL)
@@ -626,13 +857,21 @@ int main(int argc, char **argv)
         fprintf(stderr, "Path not set");
         exit(EXIT_FAILURE);
     }
-    tb_init(path);
-    if (TB_LARGEST == 0)
+    struct TbContext *ctx = tb_context_new(path);
+    if (ctx == NULL || tb_context_largest(ctx) == 0)
     {
         fprintf(stderr, "error: unable to initialize tablebase; no tablebase "
             "files found\n");
         exit(EXIT_FAILURE);
     }
+    if (bulk)
+    {
+        run_bulk(ctx, in, (unsigned)threads);
+        if (in != stdin)
+            fclose(in);
+        tb_context_free(ctx);
+        return 0;
+    }
 
     // (1) parse the FEN:
     struct pos pos0;
@@ -644,14 +883,14 @@ int main(int argc, char **argv)
     }
 
     // (2) probe the TB:
-    if (tb_pop_count(pos->white | pos->black) > TB_LARGEST)
+    if (tb_pop_count(pos->white | pos->black) > tb_context_largest(ctx))
     {
         fprintf(stderr, "error: unable to probe tablebase; FEN string \"%s\" "
-            "has too many pieces (max=%u)\n", fen, TB_LARGEST);
+            "has too many pieces (max=%u)\n", fen, tb_context_largest(ctx));
         exit(EXIT_FAILURE);
     }
     unsigned results[TB_MAX_MOVES];
-    unsigned res = tb_probe_root(pos->white, pos->black, pos->kings,
+    unsigned res = tb_probe_root(ctx, pos->white, pos->black, pos->kings,
         pos->queens, pos->rooks, pos->bishops, pos->knights, pos->pawns,
         pos->rule50, pos->castling, pos->ep, pos->turn, results);
     if (res == TB_RESULT_FAILED)
@@ -700,10 +939,10 @@ int main(int argc, char **argv)
     prev = false;
     print_moves(pos, results, prev, TB_LOSS);
     printf("\"]\n");
-    print_PV(pos);
+    print_PV(ctx, pos);
 
     struct TbRootMoves moves;
-    int result = tb_probe_root_dtz(pos->white, pos->black, pos->kings,
+    int result = tb_probe_root_dtz(ctx, pos->white, pos->black, pos->kings,
             pos->queens, pos->rooks, pos->bishops, pos->knights, pos->pawns,
                                pos->rule50, pos->castling, pos->ep, pos->turn, false, true, &moves);
 
@@ -722,7 +961,7 @@ int main(int argc, char **argv)
 
       printf("%s rank = %d score=%d\n", str, m->tbRank, m->tbScore);
     }
-    result = tb_probe_root_wdl(pos->white, pos->black, pos->kings,
+    result = tb_probe_root_wdl(ctx, pos->white, pos->black, pos->kings,
             pos->queens, pos->rooks, pos->bishops, pos->knights, pos->pawns,
                                pos->rule50, pos->castling, pos->ep, pos->turn, true, &moves);
 
@@ -740,6 +979,7 @@ int main(int argc, char **argv)
 
       printf("%s rank = %d score=%d\n", str, m->tbRank, m->tbScore);
     }
+    tb_context_free(ctx);
     return 0;
 }
 
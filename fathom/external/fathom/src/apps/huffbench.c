@@ -0,0 +1,309 @@
+/*
+ * huffbench.c
+ *
+ * Microbenchmark for the Huffman decoder of tbprobe.c (decompress_pairs).
+ *
+ * A synthetic table is generated with the same layout as a real one: a
+ * canonical Huffman code over leaf and pair symbols with a skewed frequency
+ * distribution, compressed into fixed size blocks with an index table.  Every
+ * literal is first decoded once and checked against the input, then random
+ * literals are looked up and timed.
+ *
+ * Build with and without -DTB_NO_HUFFMAN_LUT (see the Makefile "bench"
+ * target) to compare the lookup table decoder against the linear code length
+ * search.  The checksums of the two builds must be equal.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <time.h>
+
+#include "tbprobe.c"
+
+#define NUM_LEAVES  256
+#define NUM_PAIRS   768
+#define NUM_SYMBOLS (NUM_LEAVES + NUM_PAIRS)
+#define MAX_EXPAND  16          // literals per pair symbol, at most
+#define NUM_CODES   (1 << 20)   // symbols in the compressed stream
+#define NUM_LOOKUPS (1 << 22)
+#define BLOCK_SIZE  6           // log2 of the block size in bytes
+
+static uint64_t rngState = 0x9e3779b97f4a7c15ULL;
+
+static uint64_t rng(void)
+{
+    rngState ^= rngState >> 12;
+    rngState ^= rngState << 25;
+    rngState ^= rngState >> 27;
+    return rngState * 0x2545f4914f6cdd1dULL;
+}
+
+static uint64_t weight[NUM_SYMBOLS];
+static int children[NUM_SYMBOLS][2];
+static int expandLen[NUM_SYMBOLS];
+static int codeLen[NUM_SYMBOLS];
+static int order[NUM_SYMBOLS];   // canonical symbol -> generated symbol
+static int canon[NUM_SYMBOLS];   // generated symbol -> canonical symbol
+
+static int by_weight(const void *a, const void *b)
+{
+    uint64_t wa = weight[*(const int *)a], wb = weight[*(const int *)b];
+    return wa < wb ? -1 : wa > wb;
+}
+
+static int by_length(const void *a, const void *b)
+{
+    int sa = *(const int *)a, sb = *(const int *)b;
+    if (codeLen[sa] != codeLen[sb])
+        return codeLen[sb] - codeLen[sa];
+    return sa - sb;
+}
+
+// Compute Huffman code lengths for the weights (two-queue construction).
+static void huffman_lengths(void)
+{
+    int sorted[NUM_SYMBOLS];
+    uint64_t nodeWeight[2 * NUM_SYMBOLS];
+    int parent[2 * NUM_SYMBOLS], depth[2 * NUM_SYMBOLS];
+    for (int i = 0; i < NUM_SYMBOLS; i++)
+        sorted[i] = i;
+    qsort(sorted, NUM_SYMBOLS, sizeof(int), by_weight);
+    for (int i = 0; i < NUM_SYMBOLS; i++)
+        nodeWeight[i] = weight[sorted[i]];
+
+    int leaf = 0, inner = NUM_SYMBOLS, next = NUM_SYMBOLS;
+    while (next < 2 * NUM_SYMBOLS - 1) {
+        int pick[2];
+        for (int k = 0; k < 2; k++) {
+            if (leaf < NUM_SYMBOLS
+                    && (inner == next || nodeWeight[leaf] <= nodeWeight[inner]))
+                pick[k] = leaf++;
+            else
+                pick[k] = inner++;
+        }
+        nodeWeight[next] = nodeWeight[pick[0]] + nodeWeight[pick[1]];
+        parent[pick[0]] = parent[pick[1]] = next++;
+    }
+    depth[next - 1] = 0;
+    for (int i = next - 2; i >= 0; i--)
+        depth[i] = depth[parent[i]] + 1;
+    for (int i = 0; i < NUM_SYMBOLS; i++)
+        codeLen[sorted[i]] = depth[i];
+}
+
+static void put_u16(uint8_t *p, unsigned v) { p[0] = v & 0xff; p[1] = v >> 8; }
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(void)
+{
+    // Symbols: leaves are literal values, pairs expand to two earlier symbols.
+    for (int s = 0; s < NUM_SYMBOLS; s++) {
+        if (s < NUM_LEAVES) {
+            expandLen[s] = 1;
+            continue;
+        }
+        do {
+            children[s][0] = (int)(rng() % s);
+            children[s][1] = (int)(rng() % s);
+            expandLen[s] = expandLen[children[s][0]] + expandLen[children[s][1]];
+        } while (expandLen[s] > MAX_EXPAND);
+    }
+    // Zipf-like frequencies over a random ranking of the symbols.
+    for (int s = 0; s < NUM_SYMBOLS; s++)
+        order[s] = s;
+    for (int s = NUM_SYMBOLS - 1; s > 0; s--) {
+        int r = (int)(rng() % (s + 1)), tmp = order[s];
+        order[s] = order[r];
+        order[r] = tmp;
+    }
+    for (int rank = 0; rank < NUM_SYMBOLS; rank++)
+        weight[order[rank]] = (1 << 20) / (rank + 1);
+
+    // Canonical code: longest codes first, numbered from zero.
+    huffman_lengths();
+    for (int s = 0; s < NUM_SYMBOLS; s++)
+        order[s] = s;
+    qsort(order, NUM_SYMBOLS, sizeof(int), by_length);
+    for (int c = 0; c < NUM_SYMBOLS; c++)
+        canon[order[c]] = c;
+    int maxLen = codeLen[order[0]], minLen = codeLen[order[NUM_SYMBOLS - 1]];
+    int h = maxLen - minLen + 1;
+    if (maxLen > 32) {
+        fprintf(stderr, "code too long (%d bits)\n", maxLen);
+        return 1;
+    }
+    int count[64] = {0};
+    for (int s = 0; s < NUM_SYMBOLS; s++)
+        count[codeLen[s]]++;
+    uint64_t codeBase[64];
+    int symOffset[64];
+    codeBase[maxLen] = 0;
+    symOffset[maxLen] = 0;
+    for (int l = maxLen - 1; l >= minLen; l--) {
+        codeBase[l] = (codeBase[l + 1] + count[l + 1]) / 2;
+        symOffset[l] = symOffset[l + 1] + count[l + 1];
+    }
+
+    // Compress a random symbol stream into blocks.
+    uint64_t cumulative[NUM_SYMBOLS], total = 0;
+    for (int s = 0; s < NUM_SYMBOLS; s++)
+        cumulative[s] = total += weight[s];
+    size_t blockBytes = (size_t)1 << BLOCK_SIZE;
+    size_t maxBlocks = NUM_CODES * (size_t)maxLen / (8 * blockBytes - maxLen) + 2;
+    uint8_t *data = (uint8_t *)calloc(maxBlocks + 1, blockBytes);
+    uint16_t *sizeTable = (uint16_t *)malloc(maxBlocks * sizeof(uint16_t));
+    size_t *blockStart = (size_t *)malloc(maxBlocks * sizeof(size_t));
+    uint16_t *literals = (uint16_t *)malloc((size_t)NUM_CODES * MAX_EXPAND * sizeof(uint16_t));
+    uint16_t *codesBefore = (uint16_t *)malloc((size_t)NUM_CODES * MAX_EXPAND * sizeof(uint16_t));
+    size_t numLiterals = 0, numBlocks = 0, bitPos = 8 * blockBytes;
+    unsigned codesInBlock = 0;
+    for (int i = 0; i < NUM_CODES; i++) {
+        uint64_t r = rng() % total;
+        int lo = 0, hi = NUM_SYMBOLS - 1;
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            if (cumulative[mid] > r) hi = mid; else lo = mid + 1;
+        }
+        int s = lo, l = codeLen[s];
+        if (bitPos + l > 8 * blockBytes) {
+            if (numBlocks)
+                sizeTable[numBlocks - 1] = (uint16_t)(numLiterals - blockStart[numBlocks - 1] - 1);
+            blockStart[numBlocks++] = numLiterals;
+            bitPos = 0;
+            codesInBlock = 0;
+        }
+        uint64_t code = codeBase[l] + (canon[s] - symOffset[l]);
+        uint8_t *block = data + (numBlocks - 1) * blockBytes;
+        for (int b = l - 1; b >= 0; b--, bitPos++)
+            if (code >> b & 1)
+                block[bitPos / 8] |= 0x80 >> (bitPos % 8);
+
+        // Expand the symbol, remembering how many codes precede each literal.
+        int stack[MAX_EXPAND], sp = 0;
+        stack[sp++] = s;
+        codesInBlock++;
+        while (sp) {
+            int t = stack[--sp];
+            if (t < NUM_LEAVES) {
+                codesBefore[numLiterals] = (uint16_t)codesInBlock;
+                literals[numLiterals++] = (uint16_t)t;
+            } else {
+                stack[sp++] = children[t][1];
+                stack[sp++] = children[t][0];
+            }
+        }
+    }
+    sizeTable[numBlocks - 1] = (uint16_t)(numLiterals - blockStart[numBlocks - 1] - 1);
+
+    // Index table: one entry per 2^idxBits literals, pointing at the middle.
+    int idxBits = 1;
+    while (((size_t)1 << idxBits) < numLiterals / numBlocks)
+        idxBits++;
+    size_t numIndices = (numLiterals + ((size_t)1 << idxBits) - 1) >> idxBits;
+    uint8_t *indexTable = (uint8_t *)malloc(6 * numIndices);
+    for (size_t k = 0, b = 0; k < numIndices; k++) {
+        size_t pos = (k << idxBits) + ((size_t)1 << (idxBits - 1));
+        size_t target = pos < numLiterals ? pos : numLiterals - 1;
+        while (b + 1 < numBlocks && blockStart[b + 1] <= target)
+            b++;
+        uint32_t blockLe = from_le_u32((uint32_t)b);
+        memcpy(indexTable + 6 * k, &blockLe, 4);
+        put_u16(indexTable + 6 * k + 4, (unsigned)(pos - blockStart[b]));
+    }
+
+    // Table header, in the layout read by setup_pairs().
+    uint8_t *header = (uint8_t *)calloc(12 + 2 * h + 3 * NUM_SYMBOLS + 1, 1);
+    header[1] = BLOCK_SIZE;
+    header[2] = (uint8_t)idxBits;
+    uint32_t numBlocksLe = from_le_u32((uint32_t)numBlocks);
+    memcpy(header + 4, &numBlocksLe, 4);
+    header[8] = (uint8_t)maxLen;
+    header[9] = (uint8_t)minLen;
+    for (int i = 0; i < h; i++)
+        put_u16(header + 10 + 2 * i, (unsigned)symOffset[minLen + i]);
+    put_u16(header + 10 + 2 * h, NUM_SYMBOLS);
+    for (int c = 0; c < NUM_SYMBOLS; c++) {
+        uint8_t *w = header + 12 + 2 * h + 3 * c;
+        int s = order[c];
+        unsigned s1 = s < NUM_LEAVES ? (unsigned)s : (unsigned)canon[children[s][0]];
+        unsigned s2 = s < NUM_LEAVES ? 0xfff : (unsigned)canon[children[s][1]];
+        w[0] = s1 & 0xff;
+        w[1] = (uint8_t)((s1 >> 8) | (s2 & 0xf) << 4);
+        w[2] = (uint8_t)(s2 >> 4);
+    }
+
+    uint8_t *ptr = header, flags;
+    size_t size[3];
+    struct PairsData *d = setup_pairs(&ptr, numLiterals, size, &flags, WDL);
+    assert(size[0] == 6 * numIndices && size[1] == 2 * numBlocks);
+    d->indexTable = indexTable;
+    d->sizeTable = sizeTable;
+    d->data = data;
+
+    printf("%zu literals, %zu blocks of %zu bytes, code lengths %d-%d\n",
+        numLiterals, numBlocks, blockBytes, minLen, maxLen);
+
+    // Check every literal once (also warms the caches).
+    for (size_t i = 0; i < numLiterals; i++) {
+        uint8_t *w = decompress_pairs(d, i);
+        if (w[0] + ((w[1] & 0x0f) << 8) != literals[i]) {
+            fprintf(stderr, "mismatch at literal %zu\n", i);
+            return 1;
+        }
+    }
+
+    size_t *lookups = (size_t *)malloc(NUM_LOOKUPS * sizeof(size_t));
+    uint64_t codesDecoded = 0;
+    for (int i = 0; i < NUM_LOOKUPS; i++) {
+        lookups[i] = (size_t)(rng() % numLiterals);
+        codesDecoded += codesBefore[lookups[i]];
+    }
+
+    uint64_t checksum = 0;
+    double start = now();
+    for (int i = 0; i < NUM_LOOKUPS; i++)
+        checksum = checksum * 31 + decompress_pairs(d, lookups[i])[0];
+    double elapsed = now() - start;
+
+#ifdef TB_NO_HUFFMAN_LUT
+    const char *decoder = "linear search";
+#else
+    const char *decoder = "lookup table";
+#endif
+    printf("%s: %d lookups in %.3f s, %.2f M lookups/s, %.1f M symbols/s (checksum %016llx)\n",
+        decoder, NUM_LOOKUPS, elapsed, NUM_LOOKUPS / elapsed * 1e-6,
+        codesDecoded / elapsed * 1e-6, (unsigned long long)checksum);
+
+    free(lookups);
+    free(d);
+    free(header);
+    free(indexTable);
+    free(codesBefore);
+    free(literals);
+    free(blockStart);
+    free(sizeTable);
+    free(data);
+    return 0;
+}
@@ -65,6 +65,7 @@ SOFTWARE.
 
 #define BEST_NONE               0xFFFF
 #define SCORE_ILLEGAL           0x7FFF
+#define SCORE_FAILED            (-0x7FFF)
 
 // Note: WHITE, BLACK values are reverse of Stockfish
 #ifdef __cplusplus
@@ -229,9 +230,81 @@ static void knight_attacks_init(void)
 
 #endif      /* TB_KNIGHT_ATTACKS */
 
+#if defined(TB_USE_PEXT) && \
+    (!defined(TB_BISHOP_ATTACKS) || !defined(TB_ROOK_ATTACKS))
+#include <immintrin.h>
+
+#define pext(b, mask)           _pext_u64((b), (mask))
+
+/*
+ * Slider attacks by walking each of the four rays from `sq'.  This is only
+ * used to fill the PEXT tables.  With `inner' set the last square of each
+ * ray is left out, which gives the squares whose occupancy matters.
+ */
+static uint64_t slider_attacks(unsigned sq, uint64_t occ, const int dirs[4][2],
+    bool inner)
+{
+    uint64_t b = 0;
+    for (int d = 0; d < 4; d++)
+    {
+        int dr = dirs[d][0], df = dirs[d][1];
+        for (int r = (int)rank(sq) + dr, f = (int)file(sq) + df;
+                r >= 0 && r <= 7 && f >= 0 && f <= 7; r += dr, f += df)
+        {
+            if (inner && (r + dr < 0 || r + dr > 7 || f + df < 0 || f + df > 7))
+                break;
+            b |= board(square(r, f));
+            if (occ & board(square(r, f)))
+                break;
+        }
+    }
+    return b;
+}
+
+/*
+ * Fill `table' with the attacks for every subset of the relevant occupancy
+ * of every square, indexed by PEXT of the occupancy with `masks[sq]'.
+ */
+static void pext_attacks_init(uint64_t *table, uint64_t masks[64],
+    uint64_t *tables[64], const int dirs[4][2])
+{
+    for (unsigned sq = 0; sq < 64; sq++)
+    {
+        uint64_t mask = slider_attacks(sq, 0, dirs, true), occ = 0;
+        masks[sq] = mask;
+        tables[sq] = table;
+        do
+        {
+            table[pext(occ, mask)] = slider_attacks(sq, occ, dirs, false);
+            occ = (occ - mask) & mask;
+        }
+        while (occ);
+        table += (size_t)1 << popcount(mask);
+    }
+}
+
+#endif      /* TB_USE_PEXT */
+
 #ifdef TB_BISHOP_ATTACKS
 #define bishop_attacks(s, occ)  TB_BISHOP_ATTACKS(s, occ)
 #define bishop_attacks_init()   /* NOP */
+#elif defined(TB_USE_PEXT)
+
+static uint64_t bishop_masks[64];
+static uint64_t *bishop_tables[64];
+static uint64_t bishop_attacks_table[5248];
+
+static inline uint64_t bishop_attacks(unsigned sq, uint64_t occ)
+{
+    return bishop_tables[sq][pext(occ, bishop_masks[sq])];
+}
+
+static void bishop_attacks_init(void)
+{
+    static const int dirs[4][2] = {{-1, -1}, {-1, 1}, {1, -1}, {1, 1}};
+    pext_attacks_init(bishop_attacks_table, bishop_masks, bishop_tables, dirs);
+}
+
 #else       /* TB_BISHOP_ATTACKS */
 
 static uint64_t diag_attacks_table[64][64];
@@ -390,6 +463,23 @@ static void bishop_attacks_init(void)
 #ifdef TB_ROOK_ATTACKS
 #define rook_attacks(s, occ)    TB_ROOK_ATTACKS(s, occ)
 #define rook_attacks_init()     /* NOP */
+#elif defined(TB_USE_PEXT)
+
+static uint64_t rook_masks[64];
+static uint64_t *rook_tables[64];
+static uint64_t rook_attacks_table[102400];
+
+static inline uint64_t rook_attacks(unsigned sq, uint64_t occ)
+{
+    return rook_tables[sq][pext(occ, rook_masks[sq])];
+}
+
+static void rook_attacks_init(void)
+{
+    static const int dirs[4][2] = {{-1, 0}, {0, -1}, {0, 1}, {1, 0}};
+    pext_attacks_init(rook_attacks_table, rook_masks, rook_tables, dirs);
+}
+
 #else       /* TB_ROOK_ATTACKS */
 
 static uint64_t rank_attacks_table[64][64];
@@ -946,7 +1036,11 @@ static bool is_valid(const Pos *pos)
     (((b) & (~board(to)) & (~board(from))) |                            \
         ((((b) >> (from)) & 0x1) << (to)))
 
-static bool do_move(Pos *pos, const Pos *pos0, TbMove move)
+/*
+ * Make the move on a copy of the position, without testing whether it
+ * leaves the king in check.
+ */
+static void apply_move(Pos *pos, const Pos *pos0, TbMove move)
 {
     unsigned from = move_from(move); 
     unsigned to = move_to(move);  
@@ -999,6 +1093,11 @@ static bool do_move(Pos *pos, const Pos *pos0, TbMove move)
         pos->rule50 = 0;                // Capture
     else
         pos->rule50 = pos0->rule50 + 1; // Normal move
+}
+
+static bool do_move(Pos *pos, const Pos *pos0, TbMove move)
+{
+    apply_move(pos, pos0, move);
     if (!is_legal(pos))
         return false;
     return true;
@@ -1009,6 +1108,134 @@ static bool legal_move(const Pos *pos, TbMove move) {
    return do_move(&pos1, pos, move);
 }
 
+/*
+ * Bitboard of the pieces of the given colour that attack `sq', assuming the
+ * given `occ' occupancy bitboard.
+ */
+static uint64_t attackers_to(const Pos *pos, unsigned sq, uint64_t occ,
+    bool white)
+{
+    uint64_t them = (white? pos->white: pos->black);
+    return ((king_attacks(sq) & pos->kings) |
+            (knight_attacks(sq) & pos->knights) |
+            (pawn_attacks(sq, !white) & pos->pawns) |
+            (rook_attacks(sq, occ) & (pos->rooks | pos->queens)) |
+            (bishop_attacks(sq, occ) & (pos->bishops | pos->queens))) & them;
+}
+
+/*
+ * Generate all legal captures, including all underpromotions, in the same
+ * order as gen_captures().
+ *
+ * Checks and pins are worked out once up front instead of making every
+ * move and testing the resulting position: in check, only the checker can
+ * be captured (or the king must capture), and a pinned piece can only
+ * capture its pinner.  En passant captures are rare enough that they are
+ * still tested with legal_move().
+ */
+static TbMove *gen_legal_captures(const Pos *pos, TbMove *moves)
+{
+    uint64_t occ = pos->white | pos->black;
+    uint64_t us = (pos->turn? pos->white: pos->black),
+             them = (pos->turn? pos->black: pos->white);
+    uint64_t b, att;
+    unsigned ksq = lsb(pos->kings & us);
+    assert(ksq < 64);
+    uint64_t checkers = attackers_to(pos, ksq, occ, !pos->turn);
+
+    for (att = king_attacks(ksq) & them; att; att = poplsb(att))
+    {
+        unsigned to = lsb(att);
+        if (!attackers_to(pos, to, occ ^ board(ksq), !pos->turn))
+            moves = add_move(moves, false, ksq, to);
+    }
+    if (checkers & (checkers - 1))
+        return moves;                   // Double check: only the king moves
+    uint64_t target = (checkers? checkers: them);
+
+    // For each of our pieces pinned to the king, the square of its pinner.
+    uint64_t pinned = 0;
+    uint8_t pinner[64];
+    uint64_t snipers =
+        ((rook_attacks(ksq, 0) & (pos->rooks | pos->queens)) |
+         (bishop_attacks(ksq, 0) & (pos->bishops | pos->queens))) & them;
+    for (; snipers; snipers = poplsb(snipers))
+    {
+        unsigned sq = lsb(snipers);
+        uint64_t between = (rook_attacks(ksq, 0) & board(sq)?
+            rook_attacks(ksq, board(sq)) & rook_attacks(sq, board(ksq)):
+            bishop_attacks(ksq, board(sq)) & bishop_attacks(sq, board(ksq)));
+        uint64_t blockers = between & occ;
+        if (blockers != 0 && (blockers & (blockers - 1)) == 0 &&
+                (blockers & us) != 0)
+        {
+            pinned |= blockers;
+            pinner[lsb(blockers)] = (uint8_t)sq;
+        }
+    }
+#define pin_mask(from)                                                  \
+    ((pinned & board(from))? board(pinner[(from)]): ~(uint64_t)0)
+
+    for (b = us & pos->queens; b; b = poplsb(b))
+    {
+        unsigned from = lsb(b);
+        att = queen_attacks(from, occ) & target & pin_mask(from);
+        for (; att; att = poplsb(att))
+        {
+            unsigned to = lsb(att);
+            moves = add_move(moves, false, from, to);
+        }
+    }
+    for (b = us & pos->rooks; b; b = poplsb(b))
+    {
+        unsigned from = lsb(b);
+        att = rook_attacks(from, occ) & target & pin_mask(from);
+        for (; att; att = poplsb(att))
+        {
+            unsigned to = lsb(att);
+            moves = add_move(moves, false, from, to);
+        }
+    }
+    for (b = us & pos->bishops; b; b = poplsb(b))
+    {
+        unsigned from = lsb(b);
+        att = bishop_attacks(from, occ) & target & pin_mask(from);
+        for (; att; att = poplsb(att))
+        {
+            unsigned to = lsb(att);
+            moves = add_move(moves, false, from, to);
+        }
+    }
+    for (b = us & pos->knights & ~pinned; b; b = poplsb(b))
+    {
+        unsigned from = lsb(b);
+        for (att = knight_attacks(from) & target; att; att = poplsb(att))
+        {
+            unsigned to = lsb(att);
+            moves = add_move(moves, false, from, to);
+        }
+    }
+    for (b = us & pos->pawns; b; b = poplsb(b))
+    {
+        unsigned from = lsb(b);
+        att = pawn_attacks(from, pos->turn);
+        if (pos->ep != 0 && ((att & board(pos->ep)) != 0))
+        {
+            TbMove move = make_move(TB_PROMOTES_NONE, from, pos->ep);
+            if (legal_move(pos, move))
+                *moves++ = move;
+        }
+        for (att = att & target & pin_mask(from); att; att = poplsb(att))
+        {
+            unsigned to = lsb(att);
+            moves = add_move(moves, (rank(to) == 7 || rank(to) == 0), from,
+                to);
+        }
+    }
+#undef pin_mask
+    return moves;
+}
+
 /*
  * Test if the king is in checkmate.
  */
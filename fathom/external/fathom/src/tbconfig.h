@@ -65,6 +65,28 @@
  */
 /* #define TB_NO_HELPER_API */
 
+/*
+ * Define TB_NO_HUFFMAN_LUT to decode table blocks with a linear search for
+ * each code length instead of a per-table lookup table.  This saves 256
+ * bytes per table at the cost of slower probes.
+ */
+/* #define TB_NO_HUFFMAN_LUT */
+
+/*
+ * Define TB_NO_STATS to leave out the probe statistics counters (see
+ * tb_context_set_stats()) altogether.
+ */
+/* #define TB_NO_STATS */
+
+/*
+ * Define TB_USE_PEXT to compute rook and bishop attacks with the BMI2 PEXT
+ * instruction instead of rotated bitboards (unless TB_ROOK_ATTACKS or
+ * TB_BISHOP_ATTACKS are supplied).  The code must then be built for a CPU
+ * with BMI2, e.g. with -mbmi2.  Note that PEXT is very slow on AMD CPUs
+ * before Zen 3.
+ */
+/* #define TB_USE_PEXT */
+
 /*
  * Define TB_NO_HW_POP_COUNT if there is no hardware popcount instruction.
  *
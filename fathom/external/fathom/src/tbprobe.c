@@ -44,6 +44,7 @@ SOFTWARE.
 #define TB_MAX_PIECE (TB_PIECES < 7 ? 254 : 650)
 #define TB_MAX_PAWN  (TB_PIECES < 7 ? 256 : 861)
 #define TB_MAX_SYMS  4096
+#define TB_LUT_BITS  8 // code prefix bits resolved by PairsData.lenTable
 
 #ifndef _WIN32
 #include <fcntl.h>
@@ -51,6 +52,7 @@ SOFTWARE.
 #include <unistd.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <time.h>
 #define SEP_CHAR ':'
 #define FD int
 #define FD_ERR -1
@@ -286,55 +288,14 @@ static size_t file_size(FD fd) {
 #endif
 }
 
-#ifndef TB_NO_THREADS
-static LOCK_T tbMutex;
-#endif
-static int initialized = 0;
-static int numPaths = 0;
-static char *pathString = NULL;
-static char **paths = NULL;
-
-static FD open_tb(const char *str, const char *suffix)
-{
-  int i;
-  FD fd;
-  char *file;
-
-  for (i = 0; i < numPaths; i++) {
-    file = (char*)malloc(strlen(paths[i]) + strlen(str) +
-                         strlen(suffix) + 2);
-    strcpy(file, paths[i]);
-#ifdef _WIN32
-    strcat(file,"\\");
-#else
-    strcat(file,"/");
-#endif
-    strcat(file, str);
-    strcat(file, suffix);
-#ifndef _WIN32
-    fd = open(file, O_RDONLY);
-#else
-#ifdef _UNICODE
-    wchar_t ucode_name[4096];
-    size_t len;
-    mbstowcs_s(&len, ucode_name, 4096, file, _TRUNCATE);
-    /* use FILE_FLAG_RANDOM_ACCESS because we are likely to access this file
-       randomly, so prefetch is not helpful. See
-       https://github.com/official-stockfish/Stockfish/pull/1829 */
-    fd = CreateFile(ucode_name, GENERIC_READ, FILE_SHARE_READ, NULL,
-			  OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+// The attack and index tables are shared by all contexts and are computed
+// once, by whichever context is created first.
+#ifdef __cplusplus
+static atomic<int> tablesInitialized(0);
 #else
-    fd = CreateFile(file, GENERIC_READ, FILE_SHARE_READ, NULL,
-			  OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+static atomic_int tablesInitialized = 0;
 #endif
-#endif
-    free(file);
-    if (fd != FD_ERR) {
-      return fd;
-    }
-  }
-  return FD_ERR;
-}
+static size_t pageSize;
 
 static void close_tb(FD fd)
 {
@@ -408,10 +369,6 @@ static void unmap_file(void *data, map_t mapping)
 
 #define poplsb(x)               ((x) & ((x) - 1))
 
-int TB_MaxCardinality = 0, TB_MaxCardinalityDTM = 0;
-unsigned TB_LARGEST = 0;
-//extern int TB_CardinalityDTM;
-
 static const char *tbSuffix[] = { ".rtbw", ".rtbm", ".rtbz" };
 static uint32_t tbMagic[] = { 0x5d23e871, 0x88ac504b, 0xa50c66d7 };
 
@@ -432,6 +389,9 @@ struct PairsData {
   uint8_t idxBits;
   uint8_t minLen;
   uint8_t constValue[2];
+#ifndef TB_NO_HUFFMAN_LUT
+  uint8_t lenTable[1 << TB_LUT_BITS];
+#endif
   uint64_t base[1];
 };
 
@@ -442,10 +402,30 @@ struct EncInfo {
   uint8_t norm[TB_PIECES];
 };
 
+// Probe statistics are relaxed atomic counters, only updated while enabled
+// with tb_context_set_stats().
+#ifndef TB_NO_STATS
+#ifdef __cplusplus
+typedef atomic<uint64_t> stat_t;
+#else
+typedef _Atomic uint64_t stat_t;
+#endif
+#define STAT_ADD(ctx, stat, n)                                              \
+  do {                                                                      \
+    if (atomic_load_explicit(&(ctx)->statsEnabled, memory_order_relaxed))   \
+      atomic_fetch_add_explicit(&(stat), (uint64_t)(n), memory_order_relaxed); \
+  } while (0)
+#else
+#define STAT_ADD(ctx, stat, n) ((void)(ctx))
+#endif
+
 struct BaseEntry {
   uint64_t key;
+  char name[16];
   uint8_t *data[3];
   map_t mapping[3];
+  size_t size[3];
+  bool locked[3];
 #ifdef __cplusplus
   atomic<bool> ready[3];
 #else
@@ -458,6 +438,9 @@ struct BaseEntry {
     uint8_t pawns[2];
   };
   bool dtmLossOnly;
+#ifndef TB_NO_STATS
+  stat_t probes[3], blocks[3], bytes[3], initNanos[3];
+#endif
 };
 
 struct PieceEntry {
@@ -486,24 +469,50 @@ struct TbHashEntry {
   struct BaseEntry *ptr;
 };
 
-static int tbNumPiece, tbNumPawn;
-static int numWdl, numDtm, numDtz;
+// All state belonging to one set of tablebase files. Contexts are fully
+// independent of each other, so several may be alive at the same time.
+struct TbContext {
+#ifndef TB_NO_THREADS
+  LOCK_T mutex;
+#endif
+  int numPaths;
+  char *pathString;
+  char **paths;
+
+  int tbNumPiece, tbNumPawn;
+  int numWdl, numDtm, numDtz;
+  int maxCardinality, maxCardinalityDTM;
+  unsigned largest;
 
-static struct PieceEntry *pieceEntry;
-static struct PawnEntry *pawnEntry;
-static struct TbHashEntry tbHash[1 << TB_HASHBITS];
+  struct PieceEntry *pieceEntry;
+  struct PawnEntry *pawnEntry;
+  struct TbHashEntry tbHash[1 << TB_HASHBITS];
+
+#ifndef TB_NO_STATS
+#ifdef __cplusplus
+  atomic<bool> statsEnabled;
+#else
+  atomic_bool statsEnabled;
+#endif
+  stat_t wdlProbes, wdlFailures, rootProbes, rootFailures;
+#endif
+};
 
 static void init_indices(void);
 
 // Forward declarations. These functions without the tb_
 // prefix take a pos structure as input.
-static int probe_wdl(Pos *pos, int *success);
-static int probe_dtz(Pos *pos, int *success);
-static int root_probe_wdl(const Pos *pos, bool useRule50, struct TbRootMoves *rm);
-static int root_probe_dtz(const Pos *pos, bool hasRepeated, bool useRule50, struct TbRootMoves *rm);
-static uint16_t probe_root(Pos *pos, int *score, unsigned *results);
+static int probe_wdl(struct TbContext *ctx, Pos *pos, int *success);
+static int probe_dtz(struct TbContext *ctx, Pos *pos, int *success);
+static Value probe_dtm(struct TbContext *ctx, const Pos *pos, int wdl, int *success);
+static int root_probe_wdl(struct TbContext *ctx, const Pos *pos, bool useRule50, struct TbRootMoves *rm);
+static int root_probe_dtz(struct TbContext *ctx, const Pos *pos, bool hasRepeated, bool useRule50, struct TbRootMoves *rm);
+static int16_t score_root_move(struct TbContext *ctx, const Pos *pos, int dtz, TbMove move);
+static uint16_t probe_root(const Pos *pos, int dtz, const TbMove *moves,
+    const int16_t *scores, size_t len, unsigned *results);
 
 unsigned tb_probe_wdl_impl(
+    struct TbContext *ctx,
     uint64_t white,
     uint64_t black,
     uint64_t kings,
@@ -530,9 +539,13 @@ unsigned tb_probe_wdl_impl(
         turn
     };
     int success;
-    int v = probe_wdl(&pos, &success);
+    STAT_ADD(ctx, ctx->wdlProbes, 1);
+    int v = probe_wdl(ctx, &pos, &success);
     if (success == 0)
+    {
+        STAT_ADD(ctx, ctx->wdlFailures, 1);
         return TB_RESULT_FAILED;
+    }
     return (unsigned)(v + 2);
 }
 
@@ -547,6 +560,7 @@ static unsigned dtz_to_wdl(int cnt50, int dtz)
 }
 
 unsigned tb_probe_root_impl(
+    struct TbContext *ctx,
     uint64_t white,
     uint64_t black,
     uint64_t kings,
@@ -559,6 +573,121 @@ unsigned tb_probe_root_impl(
     unsigned ep,
     bool turn,
     unsigned *results)
+{
+    struct TbRootProbe rp;
+    rp.pos.white = white;
+    rp.pos.black = black;
+    rp.pos.kings = kings;
+    rp.pos.queens = queens;
+    rp.pos.rooks = rooks;
+    rp.pos.bishops = bishops;
+    rp.pos.knights = knights;
+    rp.pos.pawns = pawns;
+    rp.pos.ep = ep;
+    rp.pos.turn = turn;
+    rp.rule50 = rule50;
+    int16_t scores[TB_MAX_MOVES];
+    if (!tb_probe_root_begin(ctx, &rp))
+        return TB_RESULT_FAILED;
+    tb_probe_root_score(ctx, &rp, 0, rp.numMoves, scores);
+    return tb_probe_root_end(ctx, &rp, scores, results);
+}
+
+static Pos root_pos(const struct TbRootProbe *rp)
+{
+    const struct TbPosition *tp = &rp->pos;
+    Pos pos =
+    {
+        tp->white,
+        tp->black,
+        tp->kings,
+        tp->queens,
+        tp->rooks,
+        tp->bishops,
+        tp->knights,
+        tp->pawns,
+        (uint8_t)rp->rule50,
+        (uint8_t)tp->ep,
+        tp->turn
+    };
+    return pos;
+}
+
+bool tb_probe_root_begin(struct TbContext *ctx, struct TbRootProbe *rp)
+{
+    Pos pos = root_pos(rp);
+    int success;
+    STAT_ADD(ctx, ctx->rootProbes, 1);
+    rp->numMoves = 0;
+    if (is_valid(&pos))
+    {
+        rp->dtz = probe_dtz(ctx, &pos, &success);
+        if (success)
+        {
+            rp->numMoves = (unsigned)(gen_moves(&pos, rp->moves) - rp->moves);
+            return true;
+        }
+    }
+    STAT_ADD(ctx, ctx->rootFailures, 1);
+    return false;
+}
+
+void tb_probe_root_score(struct TbContext *ctx, const struct TbRootProbe *rp,
+    unsigned first, unsigned count, int16_t *scores)
+{
+    Pos pos = root_pos(rp);
+    for (unsigned i = 0; i < count; i++)
+    {
+        scores[i] = score_root_move(ctx, &pos, rp->dtz, rp->moves[first + i]);
+        if (scores[i] == SCORE_FAILED)
+        {
+            // The whole probe fails, so there is no need to go on.
+            for (; i < count; i++)
+                scores[i] = SCORE_FAILED;
+            return;
+        }
+    }
+}
+
+unsigned tb_probe_root_end(struct TbContext *ctx, const struct TbRootProbe *rp,
+    const int16_t *scores, unsigned *results)
+{
+    Pos pos = root_pos(rp);
+    int dtz = rp->dtz;
+    unsigned rule50 = rp->rule50;
+    TbMove move = probe_root(&pos, dtz, rp->moves, scores, rp->numMoves, results);
+    if (move == 0)
+    {
+        STAT_ADD(ctx, ctx->rootFailures, 1);
+        return TB_RESULT_FAILED;
+    }
+    if (move == MOVE_CHECKMATE)
+        return TB_RESULT_CHECKMATE;
+    if (move == MOVE_STALEMATE)
+        return TB_RESULT_STALEMATE;
+    unsigned res = 0;
+    res = TB_SET_WDL(res, dtz_to_wdl(rule50, dtz));
+    res = TB_SET_DTZ(res, (dtz < 0? -dtz: dtz));
+    res = TB_SET_FROM(res, move_from(move));
+    res = TB_SET_TO(res, move_to(move));
+    res = TB_SET_PROMOTES(res, move_promotes(move));
+    res = TB_SET_EP(res, is_en_passant(&pos, move));
+    return res;
+}
+
+unsigned tb_probe_dtz_impl(
+    struct TbContext *ctx,
+    uint64_t white,
+    uint64_t black,
+    uint64_t kings,
+    uint64_t queens,
+    uint64_t rooks,
+    uint64_t bishops,
+    uint64_t knights,
+    uint64_t pawns,
+    unsigned rule50,
+    unsigned ep,
+    bool turn)
 {
     Pos pos =
     {
@@ -574,27 +703,69 @@ unsigned tb_probe_root_impl(
         (uint8_t)ep,
         turn
     };
-    int dtz;
+    int success;
     if (!is_valid(&pos))
         return TB_RESULT_FAILED;
-    TbMove move = probe_root(&pos, &dtz, results);
-    if (move == 0)
+    int dtz = probe_dtz(ctx, &pos, &success);
+    if (!success)
         return TB_RESULT_FAILED;
-    if (move == MOVE_CHECKMATE)
-        return TB_RESULT_CHECKMATE;
-    if (move == MOVE_STALEMATE)
-        return TB_RESULT_STALEMATE;
     unsigned res = 0;
     res = TB_SET_WDL(res, dtz_to_wdl(rule50, dtz));
     res = TB_SET_DTZ(res, (dtz < 0? -dtz: dtz));
-    res = TB_SET_FROM(res, move_from(move));
-    res = TB_SET_TO(res, move_to(move));
-    res = TB_SET_PROMOTES(res, move_promotes(move));
-    res = TB_SET_EP(res, is_en_passant(&pos, move));
     return res;
 }
 
+int tb_probe_dtm_impl(
+    struct TbContext *ctx,
+    uint64_t white,
+    uint64_t black,
+    uint64_t kings,
+    uint64_t queens,
+    uint64_t rooks,
+    uint64_t bishops,
+    uint64_t knights,
+    uint64_t pawns,
+    unsigned ep,
+    bool turn,
+    int *dtm)
+{
+    // Most sets have no DTM tables at all, so fail before probing WDL.
+    if (ctx->maxCardinalityDTM < (int)popcount(white | black))
+        return 0;
+    Pos pos =
+    {
+        white,
+        black,
+        kings,
+        queens,
+        rooks,
+        bishops,
+        knights,
+        pawns,
+        0,
+        (uint8_t)ep,
+        turn
+    };
+    int success;
+    if (!is_valid(&pos))
+        return 0;
+    int wdl = probe_wdl(ctx, &pos, &success);
+    if (!success)
+        return 0;
+    if (wdl == 0)
+    {
+        *dtm = 0;
+        return 1;
+    }
+    Value v = probe_dtm(ctx, &pos, wdl, &success);
+    if (!success)
+        return 0;
+    *dtm = (v > 0? TB_VALUE_MATE - v: -(TB_VALUE_MATE + v));
+    return 1;
+}
+
 int tb_probe_root_dtz(
+    struct TbContext *ctx,
     uint64_t white,
     uint64_t black,
     uint64_t kings,
@@ -625,10 +796,11 @@ int tb_probe_root_dtz(
         turn
     };
     if (castling != 0) return 0;
-    return root_probe_dtz(&pos, hasRepeated, useRule50, results);
+    return root_probe_dtz(ctx, &pos, hasRepeated, useRule50, results);
 }
 
 int tb_probe_root_wdl(
+    struct TbContext *ctx,
     uint64_t white,
     uint64_t black,
     uint64_t kings,
@@ -658,30 +830,56 @@ int tb_probe_root_wdl(
         turn
     };
     if (castling != 0) return 0;
-    return root_probe_wdl(&pos, useRule50, results);
+    return root_probe_wdl(ctx, &pos, useRule50, results);
 }
 
-// Given a position, produce a text string of the form KQPvKRP, where
-// "KQP" represents the white pieces if flip == false and the black pieces
-// if flip == true.
-static void prt_str(const Pos *pos, char *str, bool flip)
+// Open the table file str + suffix, trying each directory of the
+// tablebase path in turn.
+static FD open_tb(const struct TbContext *ctx, const char *str, const char *suffix)
 {
-  int color = flip ? BLACK : WHITE;
+  int i;
+  FD fd;
+  char *file;
 
-  for (int pt = KING; pt >= PAWN; pt--)
-    for (int i = popcount(pieces_by_type(pos, (Color)color, (PieceType)pt)); i > 0; i--)
-      *str++ = piece_to_char[pt];
-  *str++ = 'v';
-  color ^= 1;
-  for (int pt = KING; pt >= PAWN; pt--)
-    for (int i = popcount(pieces_by_type(pos, (Color)color, (PieceType)pt)); i > 0; i--)
-      *str++ = piece_to_char[pt];
-  *str++ = 0;
+  for (i = 0; i < ctx->numPaths; i++) {
+    file = (char*)malloc(strlen(ctx->paths[i]) + strlen(str) +
+                         strlen(suffix) + 2);
+    strcpy(file, ctx->paths[i]);
+#ifdef _WIN32
+    strcat(file,"\\");
+#else
+    strcat(file,"/");
+#endif
+    strcat(file, str);
+    strcat(file, suffix);
+#ifndef _WIN32
+    fd = open(file, O_RDONLY);
+#else
+#ifdef _UNICODE
+    wchar_t ucode_name[4096];
+    size_t len;
+    mbstowcs_s(&len, ucode_name, 4096, file, _TRUNCATE);
+    /* use FILE_FLAG_RANDOM_ACCESS because we are likely to access this file
+       randomly, so prefetch is not helpful. See
+       https://github.com/official-stockfish/Stockfish/pull/1829 */
+    fd = CreateFile(ucode_name, GENERIC_READ, FILE_SHARE_READ, NULL,
+			  OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+#else
+    fd = CreateFile(file, GENERIC_READ, FILE_SHARE_READ, NULL,
+			  OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+#endif
+#endif
+    free(file);
+    if (fd != FD_ERR) {
+      return fd;
+    }
+  }
+  return FD_ERR;
 }
 
-static bool test_tb(const char *str, const char *suffix)
+static bool test_tb(const struct TbContext *ctx, const char *str, const char *suffix)
 {
-  FD fd = open_tb(str, suffix);
+  FD fd = open_tb(ctx, str, suffix);
   if (fd != FD_ERR) {
     size_t size = file_size(fd);
     close_tb(fd);
@@ -694,12 +892,13 @@ static bool test_tb(const char *str, const char *suffix)
   return fd != FD_ERR;
 }
 
-static void *map_tb(const char *name, const char *suffix, map_t *mapping)
+static void *map_tb(const struct TbContext *ctx, const char *name, const char *suffix, map_t *mapping, size_t *size)
 {
-  FD fd = open_tb(name, suffix);
+  FD fd = open_tb(ctx, name, suffix);
   if (fd == FD_ERR)
     return NULL;
 
+  *size = file_size(fd);
   void *data = map_file(fd, mapping);
   if (data == NULL) {
     fprintf(stderr, "Could not map %s%s into memory.\n", name, suffix);
@@ -711,24 +910,24 @@ static void *map_tb(const char *name, const char *suffix, map_t *mapping)
   return data;
 }
 
-static void add_to_hash(struct BaseEntry *ptr, uint64_t key)
+static void add_to_hash(struct TbContext *ctx, struct BaseEntry *ptr, uint64_t key)
 {
   int idx;
 
   idx = key >> (64 - TB_HASHBITS);
-  while (tbHash[idx].ptr)
+  while (ctx->tbHash[idx].ptr)
     idx = (idx + 1) & ((1 << TB_HASHBITS) - 1);
 
-  tbHash[idx].key = key;
-  tbHash[idx].ptr = ptr;
+  ctx->tbHash[idx].key = key;
+  ctx->tbHash[idx].ptr = ptr;
 }
 
 #define pchr(i) piece_to_char[QUEEN - (i)]
 #define Swap(a,b) {int tmp=a;a=b;b=tmp;}
 
-static void init_tb(char *str)
+static void init_tb(struct TbContext *ctx, char *str)
 {
-  if (!test_tb(str, tbSuffix[WDL]))
+  if (!test_tb(ctx, str, tbSuffix[WDL]))
     return;
 
   int pcs[16];
@@ -751,29 +950,40 @@ static void init_tb(char *str)
 
   bool hasPawns = pcs[W_PAWN] || pcs[B_PAWN];
 
-  struct BaseEntry *be = hasPawns ? &pawnEntry[tbNumPawn++].be
-                                  : &pieceEntry[tbNumPiece++].be;
+  struct BaseEntry *be = hasPawns ? &ctx->pawnEntry[ctx->tbNumPawn++].be
+                                  : &ctx->pieceEntry[ctx->tbNumPiece++].be;
   be->hasPawns = hasPawns;
   be->key = key;
+  snprintf(be->name, sizeof(be->name), "%s", str);
   be->symmetric = key == key2;
   be->num = 0;
   for (int i = 0; i < 16; i++)
     be->num += pcs[i];
 
-  numWdl++;
-  numDtm += be->hasDtm = test_tb(str, tbSuffix[DTM]);
-  numDtz += be->hasDtz = test_tb(str, tbSuffix[DTZ]);
+  ctx->numWdl++;
+  ctx->numDtm += be->hasDtm = test_tb(ctx, str, tbSuffix[DTM]);
+  ctx->numDtz += be->hasDtz = test_tb(ctx, str, tbSuffix[DTZ]);
 
-  if (be->num > TB_MaxCardinality) {
-    TB_MaxCardinality = be->num;
+  if (be->num > ctx->maxCardinality) {
+    ctx->maxCardinality = be->num;
   }
   if (be->hasDtm)
-    if (be->num > TB_MaxCardinalityDTM) {
-      TB_MaxCardinalityDTM = be->num;
+    if (be->num > ctx->maxCardinalityDTM) {
+      ctx->maxCardinalityDTM = be->num;
     }
 
-  for (int type = 0; type < 3; type++)
+  for (int type = 0; type < 3; type++) {
     atomic_init(&be->ready[type], false);
+    be->data[type] = NULL;
+    be->size[type] = 0;
+    be->locked[type] = false;
+#ifndef TB_NO_STATS
+    atomic_init(&be->probes[type], 0);
+    atomic_init(&be->blocks[type], 0);
+    atomic_init(&be->bytes[type], 0);
+    atomic_init(&be->initNanos[type], 0);
+#endif
+  }
 
   if (!be->hasPawns) {
     int j = 0;
@@ -787,9 +997,9 @@ static void init_tb(char *str)
       Swap(be->pawns[0], be->pawns[1]);
   }
 
-  add_to_hash(be, key);
+  add_to_hash(ctx, be, key);
   if (key != key2)
-    add_to_hash(be, key2);
+    add_to_hash(ctx, be, key2);
 }
 
 #define PIECE(x) ((struct PieceEntry *)(x))
@@ -812,6 +1022,7 @@ static void free_tb_entry(struct BaseEntry *be)
   for (int type = 0; type < 3; type++) {
     if (atomic_load_explicit(&be->ready[type], memory_order_relaxed)) {
       unmap_file((void*)(be->data[type]), be->mapping[type]);
+      be->locked[type] = false;
       int num = num_tables(be, type);
       struct EncInfo *ei = first_ei(be, type);
       for (int t = 0; t < num; t++) {
@@ -824,45 +1035,49 @@ static void free_tb_entry(struct BaseEntry *be)
   }
 }
 
-bool tb_init(const char *path)
+static void init_tables(void)
 {
-  if (!initialized) {
+  int expected = 0;
+  if (atomic_compare_exchange_strong(&tablesInitialized, &expected, 1)) {
     init_indices();
     king_attacks_init();
     knight_attacks_init();
     bishop_attacks_init();
     rook_attacks_init();
     pawn_attacks_init();
-    initialized = 1;
+#ifndef _WIN32
+    pageSize = (size_t)sysconf(_SC_PAGESIZE);
+#else
+    SYSTEM_INFO sysInfo;
+    GetSystemInfo(&sysInfo);
+    pageSize = sysInfo.dwPageSize;
+#endif
+    atomic_store_explicit(&tablesInitialized, 2, memory_order_release);
+  } else {
+    // Another thread got here first; wait for it to finish.
+    while (atomic_load_explicit(&tablesInitialized, memory_order_acquire) != 2)
+      ;
   }
+}
 
-  // if pathString is set, we need to clean up first.
-  if (pathString) {
-    free(pathString);
-    free(paths);
-
-    for (int i = 0; i < tbNumPiece; i++)
-      free_tb_entry((struct BaseEntry *)&pieceEntry[i]);
-    for (int i = 0; i < tbNumPawn; i++)
-      free_tb_entry((struct BaseEntry *)&pawnEntry[i]);
-
-    LOCK_DESTROY(tbMutex);
-
-    pathString = NULL;
-    numWdl = numDtm = numDtz = 0;
-  }
+struct TbContext *tb_context_new(const char *path)
+{
+  init_tables();
 
-  TB_LARGEST = 0;
+  struct TbContext *ctx = (struct TbContext*)calloc(1, sizeof(*ctx));
+  if (!ctx)
+    return NULL;
 
   // if path is an empty string or equals "<empty>", we are done.
   const char *p = path;
   if (strlen(p) == 0 || !strcmp(p, "<empty>")) {
-    return true;
+    return ctx;
   }
 
-  pathString = (char*)malloc(strlen(p) + 1);
-  strcpy(pathString, p);
-  numPaths = 0;
+  ctx->pathString = (char*)malloc(strlen(p) + 1);
+  strcpy(ctx->pathString, p);
+  char *pathString = ctx->pathString;
+  int numPaths = 0;
   for (int i = 0;; i++) {
     if (pathString[i] != SEP_CHAR)
       numPaths++;
@@ -871,30 +1086,22 @@ bool tb_init(const char *path)
     if (!pathString[i]) break;
     pathString[i] = 0;
   }
-  paths = (char**)malloc(numPaths * sizeof(*paths));
+  char **paths = (char**)malloc(numPaths * sizeof(*paths));
   for (int i = 0, j = 0; i < numPaths; i++) {
     while (!pathString[j]) j++;
     paths[i] = &pathString[j];
     while (pathString[j]) j++;
   }
+  ctx->numPaths = numPaths;
+  ctx->paths = paths;
 
-  LOCK_INIT(tbMutex);
+  LOCK_INIT(ctx->mutex);
 
-  tbNumPiece = tbNumPawn = 0;
-  TB_MaxCardinality = TB_MaxCardinalityDTM = 0;
-
-  if (!pieceEntry) {
-    pieceEntry = (struct PieceEntry*)malloc(TB_MAX_PIECE * sizeof(*pieceEntry));
-    pawnEntry = (struct PawnEntry*)malloc(TB_MAX_PAWN * sizeof(*pawnEntry));
-    if (!pieceEntry || !pawnEntry) {
-      fprintf(stderr, "Out of memory.\n");
-      exit(EXIT_FAILURE);
-    }
-  }
-
-  for (int i = 0; i < (1 << TB_HASHBITS); i++) {
-    tbHash[i].key = 0;
-    tbHash[i].ptr = NULL;
+  ctx->pieceEntry = (struct PieceEntry*)calloc(TB_MAX_PIECE, sizeof(*ctx->pieceEntry));
+  ctx->pawnEntry = (struct PawnEntry*)calloc(TB_MAX_PAWN, sizeof(*ctx->pawnEntry));
+  if (!ctx->pieceEntry || !ctx->pawnEntry) {
+    fprintf(stderr, "Out of memory.\n");
+    exit(EXIT_FAILURE);
   }
 
   char str[16];
@@ -902,33 +1109,33 @@ bool tb_init(const char *path)
 
   for (i = 0; i < 5; i++) {
     snprintf(str, 16, "K%cvK", pchr(i));
-    init_tb(str);
+    init_tb(ctx, str);
   }
 
   for (i = 0; i < 5; i++)
     for (j = i; j < 5; j++) {
       snprintf(str, 16, "K%cvK%c", pchr(i), pchr(j));
-      init_tb(str);
+      init_tb(ctx, str);
     }
 
   for (i = 0; i < 5; i++)
     for (j = i; j < 5; j++) {
       snprintf(str, 16, "K%c%cvK", pchr(i), pchr(j));
-      init_tb(str);
+      init_tb(ctx, str);
     }
 
   for (i = 0; i < 5; i++)
     for (j = i; j < 5; j++)
       for (k = 0; k < 5; k++) {
         snprintf(str, 16, "K%c%cvK%c", pchr(i), pchr(j), pchr(k));
-        init_tb(str);
+        init_tb(ctx, str);
       }
 
   for (i = 0; i < 5; i++)
     for (j = i; j < 5; j++)
       for (k = j; k < 5; k++) {
         snprintf(str, 16, "K%c%c%cvK", pchr(i), pchr(j), pchr(k));
-        init_tb(str);
+        init_tb(ctx, str);
       }
 
   // 6- and 7-piece TBs make sense only with a 64-bit address space
@@ -940,7 +1147,7 @@ bool tb_init(const char *path)
       for (k = i; k < 5; k++)
         for (l = (i == k) ? j : k; l < 5; l++) {
           snprintf(str, 16, "K%c%cvK%c%c", pchr(i), pchr(j), pchr(k), pchr(l));
-          init_tb(str);
+          init_tb(ctx, str);
         }
 
   for (i = 0; i < 5; i++)
@@ -948,7 +1155,7 @@ bool tb_init(const char *path)
       for (k = j; k < 5; k++)
         for (l = 0; l < 5; l++) {
           snprintf(str, 16, "K%c%c%cvK%c", pchr(i), pchr(j), pchr(k), pchr(l));
-          init_tb(str);
+          init_tb(ctx, str);
         }
 
   for (i = 0; i < 5; i++)
@@ -956,7 +1163,7 @@ bool tb_init(const char *path)
       for (k = j; k < 5; k++)
         for (l = k; l < 5; l++) {
           snprintf(str, 16, "K%c%c%c%cvK", pchr(i), pchr(j), pchr(k), pchr(l));
-          init_tb(str);
+          init_tb(ctx, str);
         }
 
   if (TB_PIECES < 7)
@@ -968,7 +1175,7 @@ bool tb_init(const char *path)
         for (l = k; l < 5; l++)
           for (m = l; m < 5; m++) {
             snprintf(str, 16, "K%c%c%c%c%cvK", pchr(i), pchr(j), pchr(k), pchr(l), pchr(m));
-            init_tb(str);
+            init_tb(ctx, str);
           }
 
   for (i = 0; i < 5; i++)
@@ -977,7 +1184,7 @@ bool tb_init(const char *path)
         for (l = k; l < 5; l++)
           for (m = 0; m < 5; m++) {
             snprintf(str, 16, "K%c%c%c%cvK%c", pchr(i), pchr(j), pchr(k), pchr(l), pchr(m));
-            init_tb(str);
+            init_tb(ctx, str);
           }
 
   for (i = 0; i < 5; i++)
@@ -986,28 +1193,46 @@ bool tb_init(const char *path)
         for (l = 0; l < 5; l++)
           for (m = l; m < 5; m++) {
             snprintf(str, 16, "K%c%c%cvK%c%c", pchr(i), pchr(j), pchr(k), pchr(l), pchr(m));
-            init_tb(str);
+            init_tb(ctx, str);
           }
 
 finished:
   /* TBD - assumes UCI
   printf("info string Found %d WDL, %d DTM and %d DTZ tablebase files.\n",
-      numWdl, numDtm, numDtz);
+      ctx->numWdl, ctx->numDtm, ctx->numDtz);
   fflush(stdout);
   */
-  // Set TB_LARGEST, for backward compatibility with pre-7-man Fathom
-  TB_LARGEST = (unsigned)TB_MaxCardinality;
-  if ((unsigned)TB_MaxCardinalityDTM > TB_LARGEST) {
-    TB_LARGEST = TB_MaxCardinalityDTM;
+  ctx->largest = (unsigned)ctx->maxCardinality;
+  if ((unsigned)ctx->maxCardinalityDTM > ctx->largest) {
+    ctx->largest = ctx->maxCardinalityDTM;
   }
-  return true;
+  return ctx;
 }
 
-void tb_free(void)
+void tb_context_free(struct TbContext *ctx)
 {
-  tb_init("");
-  free(pieceEntry);
-  free(pawnEntry);
+  if (!ctx)
+    return;
+
+  if (ctx->pathString) {
+    for (int i = 0; i < ctx->tbNumPiece; i++)
+      free_tb_entry((struct BaseEntry *)&ctx->pieceEntry[i]);
+    for (int i = 0; i < ctx->tbNumPawn; i++)
+      free_tb_entry((struct BaseEntry *)&ctx->pawnEntry[i]);
+
+    LOCK_DESTROY(ctx->mutex);
+
+    free(ctx->pieceEntry);
+    free(ctx->pawnEntry);
+    free(ctx->paths);
+    free(ctx->pathString);
+  }
+  free(ctx);
+}
+
+unsigned tb_context_largest(const struct TbContext *ctx)
+{
+  return ctx->largest;
 }
 
 static const int8_t OffDiag[] = {
@@ -1484,15 +1709,30 @@ static struct PairsData *setup_pairs(uint8_t **ptr, size_t tb_size,
 #else
   for (int i = 0; i < h; i++)
     d->base[i] <<= 32 - (minLen + i);
+#endif
+#ifndef TB_NO_HUFFMAN_LUT
+  // lenTable[p] is the length of the shortest code that can start with the
+  // TB_LUT_BITS bits p. Decoding starts its search for the code length
+  // there, and for codes of at most TB_LUT_BITS bits the search is done.
+  for (uint32_t p = 0; p < (1 << TB_LUT_BITS); p++) {
+#ifdef DECOMP64
+    uint64_t code = ((uint64_t)(p + 1) << (64 - TB_LUT_BITS)) - 1;
+#else
+    uint64_t code = ((uint64_t)(p + 1) << (32 - TB_LUT_BITS)) - 1;
+#endif
+    int l = 0;
+    while (code < d->base[l]) l++;
+    d->lenTable[p] = (uint8_t)(minLen + l);
+  }
 #endif
   d->offset -= d->minLen;
 
   return d;
 }
 
-static bool init_table(struct BaseEntry *be, const char *str, int type)
+static bool init_table(struct TbContext *ctx, struct BaseEntry *be, const char *str, int type)
 {
-  uint8_t *data = (uint8_t*)map_tb(str, tbSuffix[type], &be->mapping[type]);
+  uint8_t *data = (uint8_t*)map_tb(ctx, str, tbSuffix[type], &be->mapping[type], &be->size[type]);
   if (!data) return false;
 
   if (read_le_u32(data) != tbMagic[type]) {
@@ -1654,7 +1894,11 @@ static uint8_t *decompress_pairs(struct PairsData *d, size_t idx)
   ptr += 2;
   bitCnt = 0; // number of "empty bits" in code
   for (;;) {
+#ifndef TB_NO_HUFFMAN_LUT
+    int l = d->lenTable[code >> (64 - TB_LUT_BITS)];
+#else
     int l = m;
+#endif
     while (code < base[l]) l++;
     sym = from_le_u16(offset[l]);
     sym += (uint32_t)((code - base[l]) >> (64 - l));
@@ -1674,7 +1918,11 @@ static uint8_t *decompress_pairs(struct PairsData *d, size_t idx)
   uint32_t code = from_be_u32(data);
   bitCnt = 0; // number of bits in next
   for (;;) {
+#ifndef TB_NO_HUFFMAN_LUT
+    int l = d->lenTable[code >> (32 - TB_LUT_BITS)];
+#else
     int l = m;
+#endif
     while (code < base[l]) l++;
     sym = offset[l] + ((code - base[l]) >> (32 - l));
     if (litIdx < (int)symLen[sym] + 1) break;
@@ -1728,95 +1976,145 @@ inline static int fill_squares(const Pos *pos, uint8_t *pc, bool flip, int mirro
   return i;
 }
 
-int probe_table(const Pos *pos, int s, int *success, const int type)
+#ifndef TB_NO_STATS
+static uint64_t now_nanos(void)
 {
-  // Obtain the position's material-signature key
-  uint64_t key = calc_key(pos,false);
+#ifndef _WIN32
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#else
+  LARGE_INTEGER count, freq;
+  QueryPerformanceCounter(&count);
+  QueryPerformanceFrequency(&freq);
+  return (uint64_t)((double)count.QuadPart * 1e9 / (double)freq.QuadPart);
+#endif
+}
+#endif
 
-  // Test for KvK
-  // Note: Cfish has key == 2ULL for KvK but we have 0
-  if (type == WDL && key == 0ULL)
-    return 0;
+// Initialize table `type` of be, unless that has already been done.
+static bool ensure_table(struct TbContext *ctx, struct BaseEntry *be, const int type)
+{
+  // Use double-checked locking to reduce locking overhead
+  if (!atomic_load_explicit(&be->ready[type], memory_order_acquire)) {
+    LOCK(ctx->mutex);
+    if (!atomic_load_explicit(&be->ready[type], memory_order_relaxed)) {
+#ifndef TB_NO_STATS
+      uint64_t start = now_nanos();
+#endif
+      if (!init_table(ctx, be, be->name, type)) {
+        UNLOCK(ctx->mutex);
+        return false;
+      }
+#ifndef TB_NO_STATS
+      atomic_store_explicit(&be->initNanos[type], now_nanos() - start,
+          memory_order_relaxed);
+#endif
+      atomic_store_explicit(&be->ready[type], true, memory_order_release);
+    }
+    UNLOCK(ctx->mutex);
+  }
+  return true;
+}
 
+// Look up the table with material key `key`, initializing it on first use.
+// Returns NULL if the table is not available.
+static struct BaseEntry *get_table(struct TbContext *ctx, uint64_t key, const int type)
+{
+  struct TbHashEntry *tbHash = ctx->tbHash;
   int hashIdx = key >> (64 - TB_HASHBITS);
   while (tbHash[hashIdx].key && tbHash[hashIdx].key != key)
     hashIdx = (hashIdx + 1) & ((1 << TB_HASHBITS) - 1);
-  if (!tbHash[hashIdx].ptr) {
-    *success = 0;
-    return 0;
-  }
+  if (!tbHash[hashIdx].ptr)
+    return NULL;
 
   struct BaseEntry *be = tbHash[hashIdx].ptr;
-  if ((type == DTM && !be->hasDtm) || (type == DTZ && !be->hasDtz)) {
-    *success = 0;
-    return 0;
-  }
+  if ((type == DTM && !be->hasDtm) || (type == DTZ && !be->hasDtz))
+    return NULL;
 
-  // Use double-checked locking to reduce locking overhead
-  if (!atomic_load_explicit(&be->ready[type], memory_order_acquire)) {
-    LOCK(tbMutex);
-    if (!atomic_load_explicit(&be->ready[type], memory_order_relaxed)) {
-      char str[16];
-      prt_str(pos, str, be->key != key);
-      if (!init_table(be, str, type)) {
-        tbHash[hashIdx].ptr = NULL; // mark as deleted
-        *success = 0;
-        UNLOCK(tbMutex);
-        return 0;
-      }
-      atomic_store_explicit(&be->ready[type], true, memory_order_release);
-    }
-    UNLOCK(tbMutex);
+  if (!ensure_table(ctx, be, type)) {
+    tbHash[hashIdx].ptr = NULL; // mark as deleted
+    return NULL;
   }
 
-  bool bside, flip;
+  return be;
+}
+
+// Compute the index of pos in table be. Returns the encoding the index
+// belongs to, and stores the pawn file/rank (t) and table side (bside).
+static struct EncInfo *encode_position(const Pos *pos, struct BaseEntry *be, uint64_t key,
+    const int type, size_t *idx, int *t, bool *bside)
+{
+  bool flip;
   if (!be->symmetric) {
     flip = key != be->key;
-    bside = (pos->turn == WHITE) == flip;
+    *bside = (pos->turn == WHITE) == flip;
     if (type == DTM && be->hasPawns && PAWN(be)->dtmSwitched) {
       flip = !flip;
-      bside = !bside;
+      *bside = !*bside;
     }
   } else {
     flip = pos->turn != WHITE;
-    bside = false;
+    *bside = false;
   }
 
   struct EncInfo *ei = first_ei(be, type);
   int p[TB_PIECES];
-  size_t idx;
-  int t = 0;
-  uint8_t flags = 0; // initialize to fix GCC warning
+  *t = 0;
 
   if (!be->hasPawns) {
-    if (type == DTZ) {
-      flags = PIECE(be)->dtzFlags;
-      if ((flags & 1) != bside && !be->symmetric) {
-        *success = -1;
-        return 0;
-      }
-    }
-    ei = type != DTZ ? &ei[bside] : ei;
+    ei = type != DTZ ? &ei[*bside] : ei;
     for (int i = 0; i < be->num;)
       i = fill_squares(pos, ei->pieces, flip, 0, p, i);
-    idx = encode_piece(p, ei, be);
+    *idx = encode_piece(p, ei, be);
   } else {
     int i = fill_squares(pos, ei->pieces, flip, flip ? 0x38 : 0, p, 0);
-    t = leading_pawn(p, be, type != DTM ? FILE_ENC : RANK_ENC);
-    if (type == DTZ) {
-      flags = PAWN(be)->dtzFlags[t];
-      if ((flags & 1) != bside && !be->symmetric) {
-        *success = -1;
-        return 0;
-      }
-    }
-    ei =  type == WDL ? &ei[t + 4 * bside]
-        : type == DTM ? &ei[t + 6 * bside] : &ei[t];
+    *t = leading_pawn(p, be, type != DTM ? FILE_ENC : RANK_ENC);
+    ei =  type == WDL ? &ei[*t + 4 * *bside]
+        : type == DTM ? &ei[*t + 6 * *bside] : &ei[*t];
     while (i < be->num)
       i = fill_squares(pos, ei->pieces, flip, flip ? 0x38 : 0, p, i);
-    idx = type != DTM ? encode_pawn_f(p, ei, be) : encode_pawn_r(p, ei, be);
+    *idx = type != DTM ? encode_pawn_f(p, ei, be) : encode_pawn_r(p, ei, be);
+  }
+
+  return ei;
+}
+
+int probe_table(struct TbContext *ctx, const Pos *pos, int s, int *success, const int type)
+{
+  // Obtain the position's material-signature key
+  uint64_t key = calc_key(pos,false);
+
+  // Test for KvK
+  // Note: Cfish has key == 2ULL for KvK but we have 0
+  if (type == WDL && key == 0ULL)
+    return 0;
+
+  struct BaseEntry *be = get_table(ctx, key, type);
+  if (!be) {
+    *success = 0;
+    return 0;
   }
 
+  size_t idx;
+  int t;
+  bool bside;
+  struct EncInfo *ei = encode_position(pos, be, key, type, &idx, &t, &bside);
+  STAT_ADD(ctx, be->probes[type], 1);
+
+  uint8_t flags = 0; // initialize to fix GCC warning
+  if (type == DTZ) {
+    flags = be->hasPawns ? PAWN(be)->dtzFlags[t] : PIECE(be)->dtzFlags;
+    if ((flags & 1) != bside && !be->symmetric) {
+      *success = -1;
+      return 0;
+    }
+  }
+
+  if (ei->precomp->idxBits) {
+    STAT_ADD(ctx, be->blocks[type], 1);
+    STAT_ADD(ctx, be->bytes[type], (size_t)1 << ei->precomp->blockSize);
+  }
   uint8_t *w = decompress_pairs(ei->precomp, idx);
 
   if (type == WDL)
@@ -1848,39 +2146,34 @@ int probe_table(const Pos *pos, int s, int *success, const int type)
   return v;
 }
 
-static int probe_wdl_table(const Pos *pos, int *success)
+static int probe_wdl_table(struct TbContext *ctx, const Pos *pos, int *success)
 {
-  return probe_table(pos, 0, success, WDL);
+  return probe_table(ctx, pos, 0, success, WDL);
 }
 
-static int probe_dtm_table(const Pos *pos, int won, int *success)
+static int probe_dtm_table(struct TbContext *ctx, const Pos *pos, int won, int *success)
 {
-  return probe_table(pos, won, success, DTM);
+  return probe_table(ctx, pos, won, success, DTM);
 }
 
-static int probe_dtz_table(const Pos *pos, int wdl, int *success)
+static int probe_dtz_table(struct TbContext *ctx, const Pos *pos, int wdl, int *success)
 {
-  return probe_table(pos, wdl, success, DTZ);
+  return probe_table(ctx, pos, wdl, success, DTZ);
 }
 
 // probe_ab() is not called for positions with en passant captures.
-static int probe_ab(const Pos *pos, int alpha, int beta, int *success)
+static int probe_ab(struct TbContext *ctx, const Pos *pos, int alpha, int beta, int *success)
 {
   assert(pos->ep == 0);
 
   TbMove moves0[TB_MAX_CAPTURES];
   TbMove *m = moves0;
-  // Generate (at least) all legal captures including (under)promotions.
-  // It is OK to generate more, as long as they are filtered out below.
-  TbMove *end = gen_captures(pos, m);
+  // Generate all legal captures including (under)promotions.
+  TbMove *end = gen_legal_captures(pos, m);
   for (; m < end; m++) {
     Pos pos1;
-    TbMove move = *m;
-    if (!is_capture(pos, move))
-      continue;
-    if (!do_move(&pos1, pos, move))
-      continue; // illegal move
-    int v = -probe_ab(&pos1, -beta, -alpha, success);
+    apply_move(&pos1, pos, *m);
+    int v = -probe_ab(ctx, &pos1, -beta, -alpha, success);
     if (*success == 0) return 0;
     if (v > alpha) {
       if (v >= beta)
@@ -1889,7 +2182,7 @@ static int probe_ab(const Pos *pos, int alpha, int beta, int *success)
     }
   }
 
-  int v = probe_wdl_table(pos, success);
+  int v = probe_wdl_table(ctx, pos, success);
 
   return alpha >= v ? alpha : v;
 }
@@ -1909,14 +2202,14 @@ static int probe_ab(const Pos *pos, int alpha, int beta, int *success)
 //  0 : draw
 //  1 : win, but draw under 50-move rule
 //  2 : win
-int probe_wdl(Pos *pos, int *success)
+int probe_wdl(struct TbContext *ctx, Pos *pos, int *success)
 {
   *success = 1;
 
-  // Generate (at least) all legal captures including (under)promotions.
+  // Generate all legal captures including (under)promotions.
   TbMove moves0[TB_MAX_CAPTURES];
   TbMove *m = moves0;
-  TbMove *end = gen_captures(pos, m);
+  TbMove *end = gen_legal_captures(pos, m);
   int bestCap = -3, bestEp = -3;
 
   // We do capture resolution, letting bestCap keep track of the best
@@ -1926,11 +2219,8 @@ int probe_wdl(Pos *pos, int *success)
   for (; m < end; m++) {
     Pos pos1;
     TbMove move = *m;
-    if (!is_capture(pos, move))
-      continue;
-    if (!do_move(&pos1, pos, move))
-      continue; // illegal move
-    int v = -probe_ab(&pos1, -2, -bestCap, success);
+    apply_move(&pos1, pos, move);
+    int v = -probe_ab(ctx, &pos1, -2, -bestCap, success);
     if (*success == 0) return 0;
     if (v > bestCap) {
       if (v == 2) {
@@ -1944,7 +2234,7 @@ int probe_wdl(Pos *pos, int *success)
     }
   }
 
-  int v = probe_wdl_table(pos, success);
+  int v = probe_wdl_table(ctx, pos, success);
   if (*success == 0) return 0;
 
   // Now max(v, bestCap) is the WDL value of the position without ep rights.
@@ -1991,6 +2281,244 @@ int probe_wdl(Pos *pos, int *success)
   return v;
 }
 
+// Number of positions tb_probe_wdl_batch() keeps in flight at a time.
+#define TB_BATCH_SIZE 64
+
+#if defined(__GNUC__)
+#define prefetch_line(addr) __builtin_prefetch(addr)
+#else
+#define prefetch_line(addr) ((void)(addr))
+#endif
+
+// Ask the kernel to start reading [addr, addr + len) of a mapped table into
+// memory, without waiting for it. This is a system call even for resident
+// pages, so it is only worth it for whole blocks.
+static void prefetch_pages(const void *addr, size_t len)
+{
+#if !defined(_WIN32) && defined(POSIX_MADV_WILLNEED)
+  uintptr_t start = (uintptr_t)addr & ~(uintptr_t)(pageSize - 1);
+  posix_madvise((void *)start, (uintptr_t)addr + len - start, POSIX_MADV_WILLNEED);
+#else
+  (void)len;
+#endif
+  prefetch_line(addr);
+}
+
+// Probe the WDL value of each position in a batch.
+//
+// Probing a position whose table block is not resident stalls on a page
+// fault. Instead of paying those one after another, the batch is probed in
+// three passes: first all table indices are computed and their index table
+// entries prefetched, then the block each index falls in is read and
+// prefetched, and only then are the positions probed. Only the data blocks
+// are prefetched from disk, once per distinct block in the batch, the small
+// index and size table entries are just pulled into the cache.
+void tb_probe_wdl_batch(
+    struct TbContext *ctx,
+    const struct TbPosition *positions,
+    unsigned n,
+    unsigned *results)
+{
+  for (unsigned first = 0; first < n; first += TB_BATCH_SIZE) {
+    unsigned count = n - first < TB_BATCH_SIZE ? n - first : TB_BATCH_SIZE;
+    struct PairsData *precomp[TB_BATCH_SIZE];
+    size_t indices[TB_BATCH_SIZE];
+
+    for (unsigned i = 0; i < count; i++) {
+      const struct TbPosition *tp = &positions[first + i];
+      Pos pos = { tp->white, tp->black, tp->kings, tp->queens, tp->rooks,
+                  tp->bishops, tp->knights, tp->pawns, 0, (uint8_t)tp->ep, tp->turn };
+      precomp[i] = NULL;
+      uint64_t key = calc_key(&pos, false);
+      if (key == 0ULL)
+        continue;
+      struct BaseEntry *be = get_table(ctx, key, WDL);
+      if (!be)
+        continue;
+      int t;
+      bool bside;
+      struct PairsData *d = encode_position(&pos, be, key, WDL, &indices[i], &t, &bside)->precomp;
+      if (!d->idxBits)
+        continue;
+      precomp[i] = d;
+      prefetch_line(d->indexTable + 6 * (indices[i] >> d->idxBits));
+    }
+
+    const uint8_t *blocks[TB_BATCH_SIZE];
+    unsigned numBlocks = 0;
+    for (unsigned i = 0; i < count; i++) {
+      struct PairsData *d = precomp[i];
+      if (!d)
+        continue;
+      uint32_t block;
+      memcpy(&block, d->indexTable + 6 * (indices[i] >> d->idxBits), sizeof(block));
+      block = from_le_u32(block);
+      prefetch_line(d->sizeTable + block);
+      const uint8_t *data = d->data + ((size_t)block << d->blockSize);
+      unsigned j = 0;
+      while (j < numBlocks && blocks[j] != data)
+        j++;
+      if (j < numBlocks)
+        continue;
+      blocks[numBlocks++] = data;
+      prefetch_pages(data, (size_t)1 << d->blockSize);
+    }
+
+    for (unsigned i = 0; i < count; i++) {
+      const struct TbPosition *tp = &positions[first + i];
+      results[first + i] = tb_probe_wdl_impl(ctx, tp->white, tp->black, tp->kings,
+          tp->queens, tp->rooks, tp->bishops, tp->knights, tp->pawns, tp->ep, tp->turn);
+    }
+  }
+}
+
+// Fault in all pages of table `type` of be, and optionally lock them in
+// memory.
+static void make_resident(struct BaseEntry *be, int type, bool lock)
+{
+  const uint8_t *data = be->data[type];
+  size_t size = be->size[type];
+#ifndef _WIN32
+#ifdef POSIX_MADV_WILLNEED
+  posix_madvise((void *)data, size, POSIX_MADV_WILLNEED);
+#endif
+  if (lock && !be->locked[type]) {
+    if (mlock(data, size) == 0)
+      be->locked[type] = true;
+    else
+      perror("mlock");
+  }
+#else
+  if (lock && !be->locked[type]) {
+    if (VirtualLock((LPVOID)data, size))
+      be->locked[type] = true;
+    else
+      fprintf(stderr, "VirtualLock() failed, error = %lu.\n", GetLastError());
+  }
+#endif
+  volatile uint8_t sink = 0;
+  for (size_t i = 0; i < size; i += pageSize)
+    sink += data[i];
+  (void)sink;
+}
+
+// Initialize table `type` of be and read it into memory, if it fits in what
+// is left of the budget. Returns the size of the table if it was loaded.
+static uint64_t preload_table(struct TbContext *ctx, struct BaseEntry *be, int type,
+    uint64_t budget, uint64_t used, bool lock)
+{
+  if (type == DTZ && !be->hasDtz)
+    return 0;
+  if (!ensure_table(ctx, be, type))
+    return 0;
+
+  size_t size = be->size[type];
+  if (budget && used + size > budget)
+    return 0;
+  make_resident(be, type, lock);
+  return size;
+}
+
+uint64_t tb_context_preload(struct TbContext *ctx, uint64_t budget, unsigned flags)
+{
+  uint64_t used = 0;
+  bool lock = flags & TB_PRELOAD_LOCK;
+  int types[2] = { WDL, DTZ };
+
+  // WDL tables before DTZ tables, and smaller tables before larger ones.
+  for (int k = 0; k < ((flags & TB_PRELOAD_DTZ) ? 2 : 1); k++)
+    for (int num = 2; num <= ctx->maxCardinality; num++) {
+      for (int i = 0; i < ctx->tbNumPiece; i++)
+        if (ctx->pieceEntry[i].be.num == num)
+          used += preload_table(ctx, &ctx->pieceEntry[i].be, types[k], budget, used, lock);
+      for (int i = 0; i < ctx->tbNumPawn; i++)
+        if (ctx->pawnEntry[i].be.num == num)
+          used += preload_table(ctx, &ctx->pawnEntry[i].be, types[k], budget, used, lock);
+    }
+
+  return used;
+}
+
+// The i'th table of the context, piece tables first.
+static struct BaseEntry *table_entry(const struct TbContext *ctx, int i)
+{
+  return i < ctx->tbNumPiece ? &ctx->pieceEntry[i].be
+                             : &ctx->pawnEntry[i - ctx->tbNumPiece].be;
+}
+
+void tb_context_unlock(struct TbContext *ctx)
+{
+  for (int i = 0; i < ctx->tbNumPiece + ctx->tbNumPawn; i++) {
+    struct BaseEntry *be = table_entry(ctx, i);
+    for (int type = 0; type < 3; type++) {
+      if (!atomic_load_explicit(&be->ready[type], memory_order_acquire) ||
+          !be->locked[type])
+        continue;
+#ifndef _WIN32
+      if (munlock(be->data[type], be->size[type]) != 0)
+        perror("munlock");
+#else
+      if (!VirtualUnlock((LPVOID)be->data[type], be->size[type]))
+        fprintf(stderr, "VirtualUnlock() failed, error = %lu.\n", GetLastError());
+#endif
+      be->locked[type] = false;
+    }
+  }
+}
+
+void tb_context_set_stats(struct TbContext *ctx, bool enable)
+{
+#ifndef TB_NO_STATS
+  if (enable) {
+    atomic_store_explicit(&ctx->wdlProbes, 0, memory_order_relaxed);
+    atomic_store_explicit(&ctx->wdlFailures, 0, memory_order_relaxed);
+    atomic_store_explicit(&ctx->rootProbes, 0, memory_order_relaxed);
+    atomic_store_explicit(&ctx->rootFailures, 0, memory_order_relaxed);
+    for (int i = 0; i < ctx->tbNumPiece + ctx->tbNumPawn; i++) {
+      struct BaseEntry *be = table_entry(ctx, i);
+      for (int type = 0; type < 3; type++) {
+        atomic_store_explicit(&be->probes[type], 0, memory_order_relaxed);
+        atomic_store_explicit(&be->blocks[type], 0, memory_order_relaxed);
+        atomic_store_explicit(&be->bytes[type], 0, memory_order_relaxed);
+      }
+    }
+  }
+  atomic_store_explicit(&ctx->statsEnabled, enable, memory_order_relaxed);
+#else
+  (void)ctx;
+  (void)enable;
+#endif
+}
+
+unsigned tb_context_stats(const struct TbContext *ctx, struct TbStats *stats,
+    struct TbTableStats *tables, unsigned max)
+{
+  unsigned num = (unsigned)(ctx->tbNumPiece + ctx->tbNumPawn);
+  memset(stats, 0, sizeof(*stats));
+#ifndef TB_NO_STATS
+  stats->wdlProbes = atomic_load_explicit(&ctx->wdlProbes, memory_order_relaxed);
+  stats->wdlFailures = atomic_load_explicit(&ctx->wdlFailures, memory_order_relaxed);
+  stats->rootProbes = atomic_load_explicit(&ctx->rootProbes, memory_order_relaxed);
+  stats->rootFailures = atomic_load_explicit(&ctx->rootFailures, memory_order_relaxed);
+#endif
+
+  for (unsigned i = 0; i < num && i < max; i++) {
+    struct BaseEntry *be = table_entry(ctx, (int)i);
+    struct TbTableStats *ts = &tables[i];
+    memset(ts, 0, sizeof(*ts));
+    memcpy(ts->name, be->name, sizeof(ts->name));
+#ifndef TB_NO_STATS
+    for (int type = 0; type < 3; type++) {
+      ts->probes[type] = atomic_load_explicit(&be->probes[type], memory_order_relaxed);
+      ts->blocks[type] = atomic_load_explicit(&be->blocks[type], memory_order_relaxed);
+      ts->bytes[type] = atomic_load_explicit(&be->bytes[type], memory_order_relaxed);
+      ts->initNanos[type] = atomic_load_explicit(&be->initNanos[type], memory_order_relaxed);
+    }
+#endif
+  }
+  return num;
+}
+
 #if 0
 // This will not be called for positions with en passant captures
 static Value probe_dtm_dc(const Pos *pos, int won, int *success)
@@ -2028,15 +2556,15 @@ static Value probe_dtm_dc(const Pos *pos, int won, int *success)
 }
 #endif
 
-static Value probe_dtm_win(const Pos *pos, int *success);
+static Value probe_dtm_win(struct TbContext *ctx, const Pos *pos, int *success);
 
 // Probe a position known to lose by probing the DTM table and looking
 // at captures.
-static Value probe_dtm_loss(const Pos *pos, int *success)
+static Value probe_dtm_loss(struct TbContext *ctx, const Pos *pos, int *success)
 {
   Value v, best = -TB_VALUE_INFINITE, numEp = 0;
 
-  TbMove moves0[TB_MAX_CAPTURES];
+  TbMove moves0[TB_MAX_CAPTURES + TB_MAX_MOVES];
   // Generate at least all legal captures including (under)promotions
   TbMove *end, *m = moves0;
   end = gen_captures(pos, m);
@@ -2048,8 +2576,8 @@ static Value probe_dtm_loss(const Pos *pos, int *success)
       continue;
     if (is_en_passant(pos, move))
       numEp++;
-    do_move(&pos1, pos, move);
-    v = -probe_dtm_win(&pos1, success) + 1;
+    apply_move(&pos1, pos, move);
+    v = -probe_dtm_win(ctx, &pos1, success) + 1;
     if (v > best) {
       best = v;
     }
@@ -2062,30 +2590,30 @@ static Value probe_dtm_loss(const Pos *pos, int *success)
   if (numEp != 0 && gen_legal(pos, m) == m + numEp)
     return best;
 
-  v = -TB_VALUE_MATE + 2 * probe_dtm_table(pos, 0, success);
+  v = -TB_VALUE_MATE + 2 * probe_dtm_table(ctx, pos, 0, success);
   return best > v ? best : v;
 }
 
-static Value probe_dtm_win(const Pos *pos, int *success)
+static Value probe_dtm_win(struct TbContext *ctx, const Pos *pos, int *success)
 {
   Value v, best = -TB_VALUE_INFINITE;
 
   // Generate all moves
-  TbMove moves0[TB_MAX_CAPTURES];
+  TbMove moves0[TB_MAX_MOVES];
   TbMove *m = moves0;
   TbMove *end = gen_moves(pos, m);
   // Perform a 1-ply search
   Pos pos1;
   for (; m < end; m++) {
     TbMove move = *m;
-    if (do_move(&pos1, pos, move)) {
+    if (!do_move(&pos1, pos, move)) {
       // not legal
       continue;
     }
-    if ((pos1.ep > 0  ? probe_wdl(&pos1, success)
-         : probe_ab(&pos1, -1, 0, success)) < 0
+    if ((pos1.ep > 0  ? probe_wdl(ctx, &pos1, success)
+         : probe_ab(ctx, &pos1, -1, 0, success)) < 0
         && *success)
-      v = -probe_dtm_loss(&pos1, success) - 1;
+      v = -probe_dtm_loss(ctx, &pos1, success) - 1;
     else
       v = -TB_VALUE_INFINITE;
     if (v > best) {
@@ -2097,14 +2625,14 @@ static Value probe_dtm_win(const Pos *pos, int *success)
   return best;
 }
 
-Value TB_probe_dtm(const Pos *pos, int wdl, int *success)
+static Value probe_dtm(struct TbContext *ctx, const Pos *pos, int wdl, int *success)
 {
   assert(wdl != 0);
 
   *success = 1;
 
-  return wdl > 0 ? probe_dtm_win(pos, success)
-                 : probe_dtm_loss(pos, success);
+  return wdl > 0 ? probe_dtm_win(ctx, pos, success)
+                 : probe_dtm_loss(ctx, pos, success);
 }
 
 #if 0
@@ -2197,9 +2725,9 @@ static int WdlToDtz[] = { -1, -101, 0, 101, 1 };
 // In short, if a move is available resulting in dtz + 50-move-counter <= 99,
 // then do not accept moves leading to dtz + 50-move-counter == 100.
 //
-int probe_dtz(Pos *pos, int *success)
+int probe_dtz(struct TbContext *ctx, Pos *pos, int *success)
 {
-  int wdl = probe_wdl(pos, success);
+  int wdl = probe_wdl(ctx, pos, success);
   if (*success == 0) return 0;
 
   // If draw, then dtz = 0.
@@ -2226,7 +2754,7 @@ int probe_dtz(Pos *pos, int *success)
          continue;
       if (!do_move(&pos1, pos, move))
          continue; // not legal
-      int v = -probe_wdl(&pos1, success);
+      int v = -probe_wdl(ctx, &pos1, success);
       if (*success == 0) return 0;
       if (v == wdl) {
         assert(wdl < 3);
@@ -2240,7 +2768,7 @@ int probe_dtz(Pos *pos, int *success)
   // the position without ep rights. It is therefore safe to probe the
   // DTZ table with the current value of wdl.
 
-  int dtz = probe_dtz_table(pos, wdl, success);
+  int dtz = probe_dtz_table(ctx, pos, wdl, success);
   if (*success >= 0)
     return WdlToDtz[wdl + 2] + ((wdl > 0) ? dtz : -dtz);
 
@@ -2269,7 +2797,7 @@ int probe_dtz(Pos *pos, int *success)
       // move was not legal
       continue;
     }
-    int v = -probe_dtz(&pos1, success);
+    int v = -probe_dtz(ctx, &pos1, success);
     // Check for the case of mate in 1
     if (v == 1 && is_mate(&pos1))
       best = 1;
@@ -2287,7 +2815,7 @@ int probe_dtz(Pos *pos, int *success)
 
 // Use the DTZ tables to rank and score all root moves in the list.
 // A return value of 0 means that not all probes were successful.
-static int root_probe_dtz(const Pos *pos, bool hasRepeated, bool useRule50, struct TbRootMoves *rm)
+static int root_probe_dtz(struct TbContext *ctx, const Pos *pos, bool hasRepeated, bool useRule50, struct TbRootMoves *rm)
 {
   int v, success;
 
@@ -2311,12 +2839,12 @@ static int root_probe_dtz(const Pos *pos, bool hasRepeated, bool useRule50, stru
     // Calculate dtz for the current move counting from the root position.
     if (pos1.rule50 == 0) {
       // If the move resets the 50-move counter, dtz is -101/-1/0/1/101.
-      v = -probe_wdl(&pos1, &success);
+      v = -probe_wdl(ctx, &pos1, &success);
       assert(v < 3);
       v = WdlToDtz[v + 2];
     } else {
       // Otherwise, take dtz for the new position and correct by 1 ply.
-      v = -probe_dtz(&pos1, &success);
+      v = -probe_dtz(ctx, &pos1, &success);
       if (v > 0) v++;
       else if (v < 0) v--;
     }
@@ -2352,7 +2880,7 @@ static int root_probe_dtz(const Pos *pos, bool hasRepeated, bool useRule50, stru
 // Use the WDL tables to rank all root moves in the list.
 // This is a fallback for the case that some or all DTZ tables are missing.
 // A return value of 0 means that not all probes were successful.
-int root_probe_wdl(const Pos *pos, bool useRule50, struct TbRootMoves *rm)
+int root_probe_wdl(struct TbContext *ctx, const Pos *pos, bool useRule50, struct TbRootMoves *rm)
 {
   static int WdlToRank[] = { -1000, -899, 0, 899, 1000 };
   static Value WdlToValue[] = {
@@ -2374,7 +2902,7 @@ int root_probe_wdl(const Pos *pos, bool useRule50, struct TbRootMoves *rm)
     struct TbRootMove *m = &rm->moves[i];
     m->move = moves[i];
     do_move(&pos1, pos, m->move);
-    v = -probe_wdl(&pos1, &success);
+    v = -probe_wdl(ctx, &pos1, &success);
     if (!success) return 0;
     if (!useRule50)
       v = v > 0 ? 2 : v < 0 ? -2 : 0;
@@ -2391,7 +2919,7 @@ int root_probe_wdl(const Pos *pos, bool useRule50, struct TbRootMoves *rm)
 #if defined(__cplusplus) && __cplusplus >= 201703L
 [[maybe_unused]]
 #endif
-int root_probe_dtm(const Pos *pos, struct TbRootMoves *rm)
+int root_probe_dtm(struct TbContext *ctx, const Pos *pos, struct TbRootMoves *rm)
 {
   int success;
   Value tmpScore[TB_MAX_MOVES];
@@ -2410,7 +2938,7 @@ int root_probe_dtm(const Pos *pos, struct TbRootMoves *rm)
     else {
       // Probe and adjust mate score by 1 ply.
       do_move(&pos1, pos, m->pv[0]);
-      Value v = -TB_probe_dtm(&pos1, -wdl, &success);
+      Value v = -probe_dtm(ctx, &pos1, -wdl, &success);
       tmpScore[i] = wdl > 0 ? v - 1 : v + 1;
       if (success == 0)
         return 0;
@@ -2437,7 +2965,7 @@ int root_probe_dtm(const Pos *pos, struct TbRootMoves *rm)
 #if defined(__cplusplus) && __cplusplus >= 201703L
 [[maybe_unused]]
 #endif
-void tb_expand_mate(Pos *pos, struct TbRootMove *move, Value moveScore, unsigned cardinalityDTM)
+void tb_expand_mate(struct TbContext *ctx, Pos *pos, struct TbRootMove *move, Value moveScore, unsigned cardinalityDTM)
 {
   int success = 1, chk = 0;
   Value v = moveScore, w = 0;
@@ -2467,9 +2995,9 @@ void tb_expand_mate(Pos *pos, struct TbRootMove *move, Value moveScore, unsigned
         Pos pos1;
         do_move(&pos1, pos, *m);
         if (wdl < 0)
-          chk = probe_wdl(&pos1, &success); // verify that move wins
+          chk = probe_wdl(ctx, &pos1, &success); // verify that move wins
         w =  success && (wdl > 0 || chk < 0)
-           ? TB_probe_dtm(&pos1, wdl, &success)
+           ? probe_dtm(ctx, &pos1, wdl, &success)
            : 0;
         if (!success || v == w) break;
       }
@@ -2489,53 +3017,54 @@ static const int wdl_to_dtz[] =
     -1, -101, 0, 101, 1
 };
 
-// This supports the original Fathom root probe API
-static uint16_t probe_root(Pos *pos, int *score, unsigned *results)
+// Score a root move of a position with the given dtz, from the root's point
+// of view.  Returns SCORE_ILLEGAL for an illegal move and SCORE_FAILED if a
+// probe failed.
+static int16_t score_root_move(struct TbContext *ctx, const Pos *pos, int dtz, TbMove move)
 {
-    int success;
-    int dtz = probe_dtz(pos, &success);
+    Pos pos1;
+    if (!do_move(&pos1, pos, move))
+        return SCORE_ILLEGAL;
+    int success = 1;
+    int v = 0;
+    if (dtz > 0 && is_mate(&pos1))
+        v = 1;
+    else
+    {
+        if (pos1.rule50 != 0)
+        {
+            v = -probe_dtz(ctx, &pos1, &success);
+            if (v > 0)
+                v++;
+            else if (v < 0)
+                v--;
+        }
+        else
+        {
+            v = -probe_wdl(ctx, &pos1, &success);
+            v = wdl_to_dtz[v + 2];
+        }
+    }
     if (!success)
-        return 0;
+        return SCORE_FAILED;
+    return (int16_t)v;
+}
 
-    int16_t scores[MAX_MOVES];
-    uint16_t moves0[MAX_MOVES];
-    uint16_t *moves = moves0;
-    uint16_t *end = gen_moves(pos, moves);
-    size_t len = end - moves;
+// This supports the original Fathom root probe API.  Picks a move from the
+// scores of all (pseudo-legal) moves of the position.
+static uint16_t probe_root(const Pos *pos, int dtz, const TbMove *moves,
+    const int16_t *scores, size_t len, unsigned *results)
+{
     size_t num_draw = 0;
     unsigned j = 0;
     for (unsigned i = 0; i < len; i++)
     {
-        Pos pos1;
-        if (!do_move(&pos1, pos, moves[i]))
-        {
-            scores[i] = SCORE_ILLEGAL;
+        int v = scores[i];
+        if (v == SCORE_FAILED)
+            return 0;
+        if (v == SCORE_ILLEGAL)
             continue;
-        }
-        int v = 0;
-        //        print_move(pos,moves[i]);
-        if (dtz > 0 && is_mate(&pos1))
-            v = 1;
-        else
-        {
-            if (pos1.rule50 != 0)
-            {
-                v = -probe_dtz(&pos1, &success);
-                if (v > 0)
-                    v++;
-                else if (v < 0)
-                    v--;
-            }
-            else
-            {
-                v = -probe_wdl(&pos1, &success);
-                v = wdl_to_dtz[v + 2];
-            }
-        }
         num_draw += (v == 0);
-        if (!success)
-            return 0;
-        scores[i] = v;
         if (results != NULL)
         {
             unsigned res = 0;
@@ -2550,8 +3079,6 @@ static uint16_t probe_root(Pos *pos, int *score, unsigned *results)
     }
     if (results != NULL)
         results[j++] = TB_RESULT_FAILED;
-    if (score != NULL)
-        *score = dtz;
 
     // Now be a bit smart about filtering out moves.
     if (dtz > 0)        // winning (or 50-move rule draw)
@@ -54,11 +54,35 @@ typedef uint8_t bool;
 #    endif
 #endif
 
+    /*
+     * An opaque handle to one loaded set of tablebase files.  See
+     * tb_context_new().
+     */
+    struct TbContext;
+
+    /*
+     * A position for tb_probe_wdl_batch().  The fields are the same as the
+     * arguments of tb_probe_wdl().
+     */
+    struct TbPosition
+    {
+        uint64_t white;
+        uint64_t black;
+        uint64_t kings;
+        uint64_t queens;
+        uint64_t rooks;
+        uint64_t bishops;
+        uint64_t knights;
+        uint64_t pawns;
+        unsigned ep;
+        bool     turn;
+    };
+
     /*
      * Internal definitions.  Do not call these functions directly.
      */
-    extern bool     tb_init_impl(const char* _path);
-    extern unsigned tb_probe_wdl_impl(uint64_t _white,
+    extern unsigned tb_probe_wdl_impl(struct TbContext* _ctx,
+                                      uint64_t _white,
                                       uint64_t _black,
                                       uint64_t _kings,
                                       uint64_t _queens,
@@ -68,7 +92,8 @@ typedef uint8_t bool;
                                       uint64_t _pawns,
                                       unsigned _ep,
                                       bool     _turn);
-    extern unsigned tb_probe_root_impl(uint64_t  _white,
+    extern unsigned tb_probe_root_impl(struct TbContext* _ctx,
+                                       uint64_t  _white,
                                        uint64_t  _black,
                                        uint64_t  _kings,
                                        uint64_t  _queens,
@@ -80,6 +105,30 @@ typedef uint8_t bool;
                                        unsigned  _ep,
                                        bool      _turn,
                                        unsigned* _results);
+    extern unsigned tb_probe_dtz_impl(struct TbContext* _ctx,
+                                      uint64_t _white,
+                                      uint64_t _black,
+                                      uint64_t _kings,
+                                      uint64_t _queens,
+                                      uint64_t _rooks,
+                                      uint64_t _bishops,
+                                      uint64_t _knights,
+                                      uint64_t _pawns,
+                                      unsigned _rule50,
+                                      unsigned _ep,
+                                      bool     _turn);
+    extern int tb_probe_dtm_impl(struct TbContext* _ctx,
+                                 uint64_t _white,
+                                 uint64_t _black,
+                                 uint64_t _kings,
+                                 uint64_t _queens,
+                                 uint64_t _rooks,
+                                 uint64_t _bishops,
+                                 uint64_t _knights,
+                                 uint64_t _pawns,
+                                 unsigned _ep,
+                                 bool     _turn,
+                                 int*     _dtm);
 
     /****************************************************************************/
     /* MAIN API                                                                 */
@@ -150,33 +199,146 @@ typedef uint8_t bool;
 #define TB_RESULT_FAILED 0xFFFFFFFF
 
     /*
-     * The tablebase can be probed for any position where #pieces <= TB_LARGEST.
+     * Create a tablebase context.
+     *
+     * PARAMETERS:
+     * - path:
+     *   The tablebase PATH string.
+     *
+     * RETURN:
+     * - A new context, or NULL if it could not be allocated.  If no tablebase
+     *   files are found, then a valid context is still returned and
+     *   tb_context_largest() returns zero.
+     *
+     * NOTES:
+     * - Contexts share no state, so any number of them may be alive at the
+     *   same time, each with its own set of files.
+     */
+    struct TbContext* tb_context_new(const char* _path);
+
+    /*
+     * Free all resources held by the context, including any memory mapped
+     * tables.  No probe of the context may be in progress.
+     */
+    void tb_context_free(struct TbContext* _ctx);
+
+    /*
+     * The context can be probed for any position where
+     * #pieces <= tb_context_largest(ctx).
      */
-    extern unsigned TB_LARGEST;
+    unsigned tb_context_largest(const struct TbContext* _ctx);
+
+#define TB_PRELOAD_DTZ  0x1 /* Also preload DTZ tables. */
+#define TB_PRELOAD_LOCK 0x2 /* Lock preloaded tables in memory. */
 
     /*
-     * Initialize the tablebase.
+     * Initialize tables up front and read them into memory.
+     *
+     * Tables are otherwise opened, mapped and paged in on their first probe,
+     * which can stall a search for a long time.
      *
      * PARAMETERS:
-     * - path:
-     *   The tablebase PATH string.
+     * - ctx:
+     *   The tablebase context.
+     * - budget:
+     *   The maximum number of bytes to preload, or zero for no limit.  WDL
+     *   tables are loaded before DTZ tables and smaller tables before larger
+     *   ones.  Tables that don't fit in what is left of the budget are
+     *   skipped.
+     * - flags:
+     *   A combination of TB_PRELOAD_DTZ and TB_PRELOAD_LOCK.
      *
      * RETURN:
-     * - true=succes, false=failed.  The TB_LARGEST global will also be
-     *   initialized.  If no tablebase files are found, then `true' is returned
-     *   and TB_LARGEST is set to zero.
+     * - The number of bytes preloaded.
+     *
+     * NOTES:
+     * - Preloading a table again only touches its pages, but its size still
+     *   counts against the budget.
+     * - Locking may be limited by the operating system (e.g. RLIMIT_MEMLOCK).
+     *   Failures are reported on stderr, and the table stays loaded.
+     * - Locked tables stay locked until tb_context_unlock() is called or the
+     *   context is freed.
      */
-    bool tb_init(const char* _path);
+    uint64_t tb_context_preload(struct TbContext* _ctx,
+                                uint64_t          _budget,
+                                unsigned          _flags);
 
     /*
-     * Free any resources allocated by tb_init
+     * Unlock all tables locked by tb_context_preload(), so that they can be
+     * paged out again.  Must not be called while tb_context_preload() runs.
      */
-    void tb_free(void);
+    void tb_context_unlock(struct TbContext* _ctx);
+
+    /*
+     * Probe statistics of a context, see tb_context_stats().
+     */
+    struct TbStats
+    {
+        uint64_t wdlProbes;    /* Calls to tb_probe_wdl() */
+        uint64_t wdlFailures;  /* ... that returned TB_RESULT_FAILED */
+        uint64_t rootProbes;   /* Calls to tb_probe_root() */
+        uint64_t rootFailures; /* ... that returned TB_RESULT_FAILED */
+    };
+
+#define TB_STATS_WDL 0
+#define TB_STATS_DTM 1
+#define TB_STATS_DTZ 2
+
+    /*
+     * Probe statistics of one table, indexed by TB_STATS_WDL, TB_STATS_DTM
+     * and TB_STATS_DTZ for the three table files.
+     */
+    struct TbTableStats
+    {
+        char     name[16];     /* The material, e.g. "KRPvKR" */
+        uint64_t probes[3];    /* Lookups of a position in the table */
+        uint64_t blocks[3];    /* Compressed blocks decoded */
+        uint64_t bytes[3];     /* Total size of the blocks decoded */
+        uint64_t initNanos[3]; /* Time taken to open and map the table,
+                                  or zero if it has not been loaded */
+    };
+
+    /*
+     * Enable or disable collecting probe statistics.
+     *
+     * Statistics are disabled by default, as updating the shared counters
+     * from many threads costs some probe speed.  Enabling them resets all
+     * counters.  Table initialization times are always recorded.
+     */
+    void tb_context_set_stats(struct TbContext* _ctx, bool _enable);
+
+    /*
+     * Read the probe statistics of a context.
+     *
+     * PARAMETERS:
+     * - ctx:
+     *   The tablebase context.
+     * - stats:
+     *   Receives the statistics of the whole context.
+     * - tables:
+     *   Receives the statistics of up to `max' tables.
+     * - max:
+     *   The size of the `tables' array.
+     *
+     * RETURN:
+     * - The number of tables in the context, which may be more than `max'.
+     *
+     * NOTES:
+     * - Counters are read one at a time while probes may be running, so
+     *   they are not an exact snapshot.
+     * - All counters are zero if built with TB_NO_STATS.
+     */
+    unsigned tb_context_stats(const struct TbContext* _ctx,
+                              struct TbStats*         _stats,
+                              struct TbTableStats*    _tables,
+                              unsigned                _max);
 
     /*
      * Probe the Win-Draw-Loss (WDL) table.
      *
      * PARAMETERS:
+     * - ctx:
+     *   The tablebase context.
      * - white, black, kings, queens, rooks, bishops, knights, pawns:
      *   The current position (bitboards).
      * - rule50:
@@ -197,7 +359,8 @@ typedef uint8_t bool;
      * - Engines should use this function during search.
      * - This function is thread safe assuming TB_NO_THREADS is disabled.
      */
-    static inline unsigned tb_probe_wdl(uint64_t _white,
+    static inline unsigned tb_probe_wdl(struct TbContext* _ctx,
+                                        uint64_t _white,
                                         uint64_t _black,
                                         uint64_t _kings,
                                         uint64_t _queens,
@@ -214,7 +377,8 @@ typedef uint8_t bool;
             return TB_RESULT_FAILED;
         if (_rule50 != 0)
             return TB_RESULT_FAILED;
-        return tb_probe_wdl_impl(_white,
+        return tb_probe_wdl_impl(_ctx,
+                                 _white,
                                  _black,
                                  _kings,
                                  _queens,
@@ -226,10 +390,42 @@ typedef uint8_t bool;
                                  _turn);
     }
 
+    /*
+     * Probe the Win-Draw-Loss (WDL) table for several positions at once.
+     *
+     * PARAMETERS:
+     * - ctx:
+     *   The tablebase context.
+     * - positions:
+     *   The positions to probe.  As for tb_probe_wdl(), the positions must
+     *   have no castling rights and a zero half-move clock.
+     * - n:
+     *   The number of positions.
+     * - results:
+     *   An array of size n, where the result for each position is stored.
+     *
+     * RETURN:
+     * - Each result is one of {TB_LOSS, TB_BLESSED_LOSS, TB_DRAW,
+     *   TB_CURSED_WIN, TB_WIN}, or TB_RESULT_FAILED if that probe failed.
+     *
+     * NOTES:
+     * - The results are the same as calling tb_probe_wdl() for each position,
+     *   but the table blocks for all positions are prefetched before any of
+     *   them are decoded.  When the tables are not resident in memory, this
+     *   overlaps the page faults instead of waiting for each in turn.
+     * - This function is thread safe assuming TB_NO_THREADS is disabled.
+     */
+    extern void tb_probe_wdl_batch(struct TbContext*         _ctx,
+                                   const struct TbPosition* _positions,
+                                   unsigned                 _n,
+                                   unsigned*                _results);
+
     /*
      * Probe the Distance-To-Zero (DTZ) table.
      *
      * PARAMETERS:
+     * - ctx:
+     *   The tablebase context.
      * - white, black, kings, queens, rooks, bishops, knights, pawns:
      *   The current position (bitboards).
      * - rule50:
@@ -268,10 +464,13 @@ typedef uint8_t bool;
      * - DTZ tablebases can suggest unnatural moves, especially for losing
      *   positions.  Engines may prefer to traditional search combined with WDL
      *   move filtering using the alternative results array.
-     * - This function is NOT thread safe.  For engines this function should only
-     *   be called once at the root per search.
+     * - This function is thread safe assuming TB_NO_THREADS is disabled.  For
+     *   engines this function should only be called once at the root per
+     *   search.  See tb_probe_root_begin() to spread the probe over several
+     *   threads.
      */
-    static inline unsigned tb_probe_root(uint64_t  _white,
+    static inline unsigned tb_probe_root(struct TbContext* _ctx,
+                                         uint64_t  _white,
                                          uint64_t  _black,
                                          uint64_t  _kings,
                                          uint64_t  _queens,
@@ -287,7 +486,8 @@ typedef uint8_t bool;
     {
         if (_castling != 0)
             return TB_RESULT_FAILED;
-        return tb_probe_root_impl(_white,
+        return tb_probe_root_impl(_ctx,
+                                  _white,
                                   _black,
                                   _kings,
                                   _queens,
@@ -301,6 +501,185 @@ typedef uint8_t bool;
                                   _results);
     }
 
+    /*
+     * The state of a root probe split over several calls, see
+     * tb_probe_root_begin().
+     */
+    struct TbRootProbe
+    {
+        struct TbPosition pos;
+        unsigned rule50;
+        int      dtz;
+        unsigned numMoves;
+        uint16_t moves[TB_MAX_MOVES];
+    };
+
+    /*
+     * Probe the DTZ table at the root in steps, so that the moves can be
+     * scored by several threads.  tb_probe_root() is the same as:
+     *
+     *   if (!tb_probe_root_begin(ctx, &rp))
+     *       return TB_RESULT_FAILED;
+     *   tb_probe_root_score(ctx, &rp, 0, rp.numMoves, scores);
+     *   return tb_probe_root_end(ctx, &rp, scores, results);
+     *
+     * PARAMETERS:
+     * - ctx:
+     *   The tablebase context.
+     * - rp:
+     *   The probe.  The caller fills in pos and rule50 before calling
+     *   tb_probe_root_begin(), which sets the other fields.  Castling rights
+     *   must be checked by the caller, as for tb_probe_root().
+     * - first, count:
+     *   The range of rp->moves to score.
+     * - scores:
+     *   tb_probe_root_score() stores the score of rp->moves[first + i] in
+     *   scores[i].  tb_probe_root_end() takes all rp->numMoves scores.
+     * - results:
+     *   As for tb_probe_root().
+     *
+     * RETURN:
+     * - tb_probe_root_begin() returns false if the probe failed, in which case
+     *   the other functions must not be called.
+     * - tb_probe_root_end() returns the same as tb_probe_root().
+     *
+     * NOTES:
+     * - tb_probe_root_score() does the bulk of the work, one probe per move.
+     *   It may be called from several threads at once for disjoint ranges.
+     * - These functions are thread safe assuming TB_NO_THREADS is disabled.
+     */
+    extern bool tb_probe_root_begin(struct TbContext*   _ctx,
+                                    struct TbRootProbe* _rp);
+    extern void tb_probe_root_score(struct TbContext*         _ctx,
+                                    const struct TbRootProbe* _rp,
+                                    unsigned                  _first,
+                                    unsigned                  _count,
+                                    int16_t*                  _scores);
+    extern unsigned tb_probe_root_end(struct TbContext*         _ctx,
+                                      const struct TbRootProbe* _rp,
+                                      const int16_t*            _scores,
+                                      unsigned*                 _results);
+
+    /*
+     * Probe the Distance-To-Zero (DTZ) table of a single position.
+     *
+     * PARAMETERS:
+     * - ctx:
+     *   The tablebase context.
+     * - white, black, kings, queens, rooks, bishops, knights, pawns:
+     *   The current position (bitboards).
+     * - rule50:
+     *   The 50-move half-move clock.
+     * - castling:
+     *   Castling rights.  Set to zero if no castling is possible.
+     * - ep:
+     *   The en passant square (if exists).  Set to zero if there is no en passant
+     *   square.
+     * - turn:
+     *   true=white, false=black
+     *
+     * RETURN:
+     * - A TB_RESULT value with the WDL value (TB_GET_WDL) and the DTZ value
+     *   (TB_GET_DTZ) of the position, but no move.  Otherwise returns
+     *   TB_RESULT_FAILED if the probe failed.
+     *
+     * NOTES:
+     * - Unlike tb_probe_root(), this does not probe the moves of the position,
+     *   so it costs about one DTZ probe.  Checkmate and stalemate are not
+     *   reported separately.
+     * - This function is thread safe assuming TB_NO_THREADS is disabled.
+     */
+    static inline unsigned tb_probe_dtz(struct TbContext* _ctx,
+                                        uint64_t _white,
+                                        uint64_t _black,
+                                        uint64_t _kings,
+                                        uint64_t _queens,
+                                        uint64_t _rooks,
+                                        uint64_t _bishops,
+                                        uint64_t _knights,
+                                        uint64_t _pawns,
+                                        unsigned _rule50,
+                                        unsigned _castling,
+                                        unsigned _ep,
+                                        bool     _turn)
+    {
+        if (_castling != 0)
+            return TB_RESULT_FAILED;
+        return tb_probe_dtz_impl(_ctx,
+                                 _white,
+                                 _black,
+                                 _kings,
+                                 _queens,
+                                 _rooks,
+                                 _bishops,
+                                 _knights,
+                                 _pawns,
+                                 _rule50,
+                                 _ep,
+                                 _turn);
+    }
+
+    /*
+     * Probe the Depth-To-Mate (DTM) tables.
+     *
+     * PARAMETERS:
+     * - ctx:
+     *   The tablebase context.
+     * - white, black, kings, queens, rooks, bishops, knights, pawns:
+     *   The current position (bitboards).
+     * - castling:
+     *   Castling rights.  Set to zero if no castling is possible.
+     * - ep:
+     *   The en passant square (if exists).  Set to zero if there is no en passant
+     *   square.
+     * - turn:
+     *   true=white, false=black
+     * - dtm:
+     *   The number of plies to mate, ignoring the 50-move rule.  Positive if
+     *   the side to move wins, negative if it loses, and zero for a draw (or
+     *   if the side to move is mated).
+     *
+     * RETURN:
+     * - 1 on success, or 0 if the probe failed.
+     *
+     * NOTES:
+     * - The Syzygy tables do not have DTM, so this needs .rtbm files for the
+     *   position and for every position reached by captures from it.  Fails
+     *   otherwise.
+     * - The probe searches the moves of won positions, so it is much slower
+     *   than tb_probe_wdl().
+     * - This function is thread safe assuming TB_NO_THREADS is disabled.
+     */
+    static inline int tb_probe_dtm(struct TbContext* _ctx,
+                                   uint64_t _white,
+                                   uint64_t _black,
+                                   uint64_t _kings,
+                                   uint64_t _queens,
+                                   uint64_t _rooks,
+                                   uint64_t _bishops,
+                                   uint64_t _knights,
+                                   uint64_t _pawns,
+                                   unsigned _castling,
+                                   unsigned _ep,
+                                   bool     _turn,
+                                   int*     _dtm)
+    {
+        if (_castling != 0)
+            return 0;
+        return tb_probe_dtm_impl(_ctx,
+                                 _white,
+                                 _black,
+                                 _kings,
+                                 _queens,
+                                 _rooks,
+                                 _bishops,
+                                 _knights,
+                                 _pawns,
+                                 _ep,
+                                 _turn,
+                                 _dtm);
+    }
+
     typedef uint16_t TbMove;
 
 #define TB_MOVE_FROM(move) (((move) >> 6) & 0x3F)
@@ -332,7 +711,8 @@ typedef uint8_t bool;
      *   non-zero if ok, 0 means not all probes were successful
      *
      */
-    int tb_probe_root_dtz(uint64_t            _white,
+    int tb_probe_root_dtz(struct TbContext*   _ctx,
+                          uint64_t            _white,
                           uint64_t            _black,
                           uint64_t            _kings,
                           uint64_t            _queens,
@@ -360,7 +740,8 @@ typedef uint8_t bool;
      *   non-zero if ok, 0 means not all probes were successful
      *
      */
-    int tb_probe_root_wdl(uint64_t            _white,
+    int tb_probe_root_wdl(struct TbContext*   _ctx,
+                          uint64_t            _white,
                           uint64_t            _black,
                           uint64_t            _kings,
                           uint64_t            _queens,
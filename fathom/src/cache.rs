@@ -0,0 +1,142 @@
+//! Shared cache of WDL probe results.
+//!
+//! Probing the tablebase resolves all captures recursively and decompresses a block of the table,
+//! even if the same position was probed a few nodes earlier. This cache keeps the results of
+//! recent probes in a fixed-size table indexed by the Zobrist key of the position, so that
+//! repeated probes are a single memory load.
+use std::sync::atomic::{AtomicU64, Ordering};
+
+use super::Wdl;
+
+/// An entry in the cache.
+///
+/// An [`Entry`] is a single 64 bit word, defined as below:
+///
+/// key    61 bit (the upper 61 bits of the Zobrist key)
+/// wdl     3 bit (zero for an empty entry, see [`Entry::encode`])
+///
+/// As the whole entry is read and written with a single atomic operation, no locking is needed
+/// for threads to share the cache. Concurrent stores to the same slot simply replace each other,
+/// but a load always sees a complete entry, so a result can never be returned for the wrong key.
+#[derive(Debug, Default)]
+struct Entry(AtomicU64);
+
+/// A fixed-size, lock-free cache of WDL results.
+#[derive(Debug, Default)]
+pub struct WdlCache {
+    entries: Box<[Entry]>,
+}
+
+impl WdlCache {
+    const WDL_MASK: u64 = 0b111;
+
+    /// Create a new cache with the given size in bytes.
+    ///
+    /// A size smaller than a single entry disables the cache.
+    pub fn new(size: usize) -> Self {
+        let entry_count = size / std::mem::size_of::<Entry>();
+        Self {
+            entries: std::iter::repeat_with(Entry::default)
+                .take(entry_count)
+                .collect(),
+        }
+    }
+
+    /// Return the size of the cache in bytes.
+    pub fn size(&self) -> usize {
+        std::mem::size_of_val(&*self.entries)
+    }
+
+    /// Retrieve the result stored for the given key, or [`None`] if the key is not found.
+    #[inline]
+    pub fn probe(&self, key: u64) -> Option<Wdl> {
+        let data = self.entry_for(key)?.0.load(Ordering::Relaxed);
+        if data & !Self::WDL_MASK != key & !Self::WDL_MASK {
+            return None;
+        }
+        Entry::decode(data & Self::WDL_MASK)
+    }
+
+    /// Store the result for the given key, replacing whatever occupied its slot.
+    #[inline]
+    pub fn store(&self, key: u64, wdl: Wdl) {
+        if let Some(entry) = self.entry_for(key) {
+            entry.0.store(
+                (key & !Self::WDL_MASK) | Entry::encode(wdl),
+                Ordering::Relaxed,
+            );
+        }
+    }
+
+    fn entry_for(&self, key: u64) -> Option<&Entry> {
+        let len = self.entries.len() as u64;
+        #[allow(clippy::cast_possible_truncation)]
+        self.entries.get(mul_hi64(key, len) as usize)
+    }
+}
+
+impl Entry {
+    fn encode(wdl: Wdl) -> u64 {
+        match wdl {
+            Wdl::Loss => 1,
+            Wdl::BlessedLoss => 2,
+            Wdl::Draw => 3,
+            Wdl::CursedWin => 4,
+            Wdl::Win => 5,
+        }
+    }
+
+    fn decode(bits: u64) -> Option<Wdl> {
+        match bits {
+            1 => Some(Wdl::Loss),
+            2 => Some(Wdl::BlessedLoss),
+            3 => Some(Wdl::Draw),
+            4 => Some(Wdl::CursedWin),
+            5 => Some(Wdl::Win),
+            _ => None,
+        }
+    }
+}
+
+/// Return the higher 64 bits of the product of two 64-bit integers.
+///
+/// This is in the range `[0, b)`, and is used to map a uniformly distributed key to an index.
+fn mul_hi64(a: u64, b: u64) -> u64 {
+    ((u128::from(a) * u128::from(b)) >> 64) as u64
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_store_and_probe() {
+        let cache = WdlCache::new(1024);
+        assert_eq!(cache.size(), 1024);
+
+        let key = 0x1234_5678_9abc_def0;
+        assert_eq!(cache.probe(key), None);
+        cache.store(key, Wdl::CursedWin);
+        assert_eq!(cache.probe(key), Some(Wdl::CursedWin));
+        cache.store(key, Wdl::Loss);
+        assert_eq!(cache.probe(key), Some(Wdl::Loss));
+    }
+
+    #[test]
+    fn test_other_key_in_same_slot_misses() {
+        let cache = WdlCache::new(1024);
+        let key = 0x1234_5678_9abc_def0;
+        cache.store(key, Wdl::Win);
+
+        // Same slot (upper bits), different key.
+        assert_eq!(cache.probe(key ^ 0b1000), None);
+    }
+
+    #[test]
+    fn test_disabled_cache() {
+        let cache = WdlCache::new(0);
+        assert_eq!(cache.size(), 0);
+        cache.store(42, Wdl::Draw);
+        assert_eq!(cache.probe(42), None);
+    }
+}
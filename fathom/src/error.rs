@@ -2,7 +2,6 @@
 pub enum Error {
     InvalidPath,
     FailedToInitialize,
-    AlreadyInitialized,
     NoFilesFound,
 }
 
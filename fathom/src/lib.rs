@@ -1,101 +1,150 @@
+mod cache;
 mod error;
 mod probe;
+mod stats;
 mod sys;
 mod wdl;
 
-use std::marker::PhantomData;
-use std::sync::Mutex;
+use std::ptr::NonNull;
 use std::{ffi::CString, path::Path};
 
 pub use error::Error;
+pub use stats::{FileStats, Stats, TableStats};
 pub use wdl::Wdl;
 
-// The undelying C library doesn't support more than one loaded tablebase, so we model this
-// by enforcing that only one entity may control the tablebase at any one time.
-#[derive(Debug)]
-pub struct TablebaseOwnership(PhantomData<()>);
-
-static TB_OWNER: Mutex<Option<TablebaseOwnership>> =
-    Mutex::new(Some(TablebaseOwnership(PhantomData)));
-
-impl Drop for TablebaseOwnership {
-    fn drop(&mut self) {
-        *TB_OWNER.lock().unwrap() = Some(TablebaseOwnership(PhantomData));
-    }
-}
-
 /// An initialized fathom tablebase instance.
+///
+/// Each instance owns its own set of loaded tables, so any number of them may exist at the same
+/// time, e.g. with different paths. All resources are released when the instance is dropped.
+///
+/// WDL probe results are kept in a shared cache, which is disabled until sized with
+/// [`Tablebase::set_cache_size`].
 #[derive(Debug)]
 pub struct Tablebase {
+    context: NonNull<sys::TbContext>,
     max_pieces: u32,
-    _ownership: TablebaseOwnership,
+    cache: cache::WdlCache,
 }
 
+// Safety: The context is owned exclusively by this instance, and the C library synchronizes the
+// lazy initialization of tables internally, so probes may be issued from any thread.
+unsafe impl Send for Tablebase {}
+unsafe impl Sync for Tablebase {}
+
 impl Tablebase {
-    /// Attempt to aquire the tablebase.
-    ///
-    /// Returns [`None`] if someone else already owns it.
+    /// Load a Syzygy tablebase from the given path.
     ///
-    /// # Panics
-    /// Panics if the tablebase ownership system has been poisoned.
-    pub fn acquire() -> Option<TablebaseOwnership> {
-        TB_OWNER.lock().unwrap().take()
+    /// # Errors
+    /// Returns an error if the path is invalid, the tablebase failed to initialize, or no files
+    /// were found at the given path.
+    pub fn load<P: AsRef<Path>>(path: P) -> Result<Self, Error> {
+        let pathref = path.as_ref();
+        let pathstr = pathref.to_str().ok_or(Error::InvalidPath)?;
+        let c_string = CString::new(pathstr).map_err(|_| Error::InvalidPath)?;
+
+        // Safety: The path is a valid, nul-terminated string, which the C library copies.
+        let context = unsafe { sys::tb_context_new(c_string.as_ptr()) };
+        let context = NonNull::new(context).ok_or(Error::FailedToInitialize)?;
+
+        let tablebase = Tablebase {
+            context,
+            // Safety: The context was just created and is valid.
+            max_pieces: unsafe { sys::tb_context_largest(context.as_ptr()) },
+            cache: cache::WdlCache::default(),
+        };
+
+        if tablebase.max_pieces == 0 {
+            return Err(Error::NoFilesFound);
+        }
+
+        Ok(tablebase)
     }
 
-    /// Give back the tablebase for someone else to use.
+    /// Resize the WDL result cache to the given size in bytes.
     ///
-    /// This is equivalent to dropping the ownership, and just exists for symmetry in the API, and
-    /// for those who prefer being explicit about their intent.
-    pub fn release(ownership: TablebaseOwnership) {
-        drop(ownership);
+    /// This clears the cache. A size of zero disables it.
+    pub fn set_cache_size(&mut self, size: usize) {
+        self.cache = cache::WdlCache::new(size);
     }
 
-    /// Load a Syzygy tablebase from the given path.
+    /// Initialize all tables up front and read them into memory.
     ///
-    /// Calling this requires obtaining [`TablebaseOwnership`] first, which is done with [`Tablebase::acquire`].
-    /// If sucessful, the resulting [`Tablebase`] embeds the ownership token, and the tablebase is
-    /// only made available to others once dropped.
+    /// Otherwise each table is opened, mapped and paged in on its first probe, which can stall a
+    /// search at the worst possible time. WDL tables are loaded before DTZ tables, and smaller
+    /// tables before larger ones, skipping any table that doesn't fit in what is left of
+    /// `budget` bytes (`None` for no limit). With `lock`, the loaded tables are also locked in
+    /// memory, so that they can't be paged out again, until [`Tablebase::unlock`] is called.
     ///
-    /// # Errors
-    /// Returns an error if the path is invalid, the tablebase failed to initialize, no files were
-    /// found at the given path, or if has already been initialized.
-    ///
-    /// In all cases the tablebase ownership is also returned, so that you may try again without
-    /// losing your ownership.
-    ///
-    /// # Safety
-    /// This function is not thread-safe. No other thread should call it at the same time.
-    /// Furthermore, calling this may invalidate any other references to the tablebase, or
-    /// corrupt probes that are in progress.
-    ///
-    /// The presence of the [`TablebaseOwnership`] parameter enforces these safety requirements,
-    /// so therefore the function is not marked as unsafe.
-    pub fn load<P: AsRef<Path>>(
-        ownership: TablebaseOwnership,
-        path: P,
-    ) -> Result<Self, (Error, TablebaseOwnership)> {
-        let pathref = path.as_ref();
-        let Some(pathstr) = pathref.to_str() else {
-            return Err((Error::InvalidPath, ownership));
-        };
-        let Ok(c_string) = CString::new(pathstr) else {
-            return Err((Error::InvalidPath, ownership));
+    /// Returns the number of bytes preloaded.
+    #[must_use]
+    pub fn preload(&self, budget: Option<usize>, lock: bool) -> usize {
+        let budget = match budget {
+            Some(0) => return 0,
+            Some(budget) => budget as u64,
+            None => 0,
         };
+        let flags = sys::TB_PRELOAD_DTZ | if lock { sys::TB_PRELOAD_LOCK } else { 0 };
 
-        let success = unsafe { sys::tb_init(c_string.as_ptr()) };
+        // Safety: The context is valid, and table initialization is synchronized internally.
+        let loaded = unsafe { sys::tb_context_preload(self.context.as_ptr(), budget, flags) };
+        usize::try_from(loaded).unwrap_or(usize::MAX)
+    }
 
-        if !success {
-            return Err((Error::FailedToInitialize, ownership));
-        }
+    /// Unlock all tables locked by [`Tablebase::preload`], so that they can be paged out again.
+    ///
+    /// This must not run at the same time as [`Tablebase::preload`], which the `&mut self`
+    /// receiver ensures.
+    pub fn unlock(&mut self) {
+        // Safety: The context is valid, and no preload can be running.
+        unsafe { sys::tb_context_unlock(self.context.as_ptr()) };
+    }
 
-        let max_pieces = unsafe { sys::TB_LARGEST };
-        if max_pieces == 0 {
-            return Err((Error::NoFilesFound, ownership));
+    /// Enable or disable collecting probe statistics, see [`Tablebase::stats`].
+    ///
+    /// Statistics are disabled by default, as updating the shared counters from many threads
+    /// costs some probe speed. Enabling them resets all counters.
+    pub fn set_stats_enabled(&self, enable: bool) {
+        // Safety: The context is valid, and the counters are atomic.
+        unsafe { sys::tb_context_set_stats(self.context.as_ptr(), enable) };
+    }
+
+    /// Return the probe statistics collected since they were enabled.
+    ///
+    /// The time taken to load each table is recorded even while statistics are disabled.
+    #[must_use]
+    pub fn stats(&self) -> Stats {
+        let mut stats = sys::TbStats::default();
+        let mut tables = Vec::new();
+        loop {
+            let max = u32::try_from(tables.len()).unwrap_or(u32::MAX);
+            // Safety: The context is valid, and `tables` holds `max` elements.
+            let count = unsafe {
+                sys::tb_context_stats(
+                    self.context.as_ptr(),
+                    &raw mut stats,
+                    tables.as_mut_ptr(),
+                    max,
+                )
+            };
+            if count <= max {
+                tables.truncate(count as usize);
+                return Stats::new(&stats, &tables);
+            }
+            tables.resize(count as usize, sys::TbTableStats::default());
         }
+    }
 
-        Ok(Tablebase {
-            max_pieces,
-            _ownership: ownership,
-        })
+    /// Return the size of the WDL result cache in bytes.
+    #[must_use]
+    pub fn cache_size(&self) -> usize {
+        self.cache.size()
+    }
+}
+
+impl Drop for Tablebase {
+    fn drop(&mut self) {
+        // Safety: The context was created by `tb_context_new`, and no probes can be running as
+        // they all borrow `self`.
+        unsafe { sys::tb_context_free(self.context.as_ptr()) };
     }
 }
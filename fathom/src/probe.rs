@@ -6,7 +6,8 @@ impl Tablebase {
     /// Probe the Win-Draw-Loss result of the given position.
     ///
     /// If the position is not in the tablebase, this function will return `None` quickly. As such
-    /// it can be called during search without any pre-checks.
+    /// it can be called during search without any pre-checks. Results are served from the cache
+    /// when the same position has been probed before.
     ///
     /// # Safety
     /// While not marked as `unsafe`, this function's result is undefined if the board does not
@@ -14,20 +15,21 @@ impl Tablebase {
     #[must_use]
     #[inline]
     pub fn probe_wdl(&self, board: &Board, halfmove_clock: usize) -> Option<Wdl> {
-        if halfmove_clock > 0
-            || board.castle_rights(Color::White) != CastleRights::NoRights
-            || board.castle_rights(Color::Black) != CastleRights::NoRights
-            || (board.color_combined(Color::White) | board.color_combined(Color::Black)).popcnt()
-                > self.max_pieces
-        {
+        if halfmove_clock > 0 || !self.may_contain(board) {
             return None;
         }
 
+        let key = board.get_hash();
+        if let Some(wdl) = self.cache.probe(key) {
+            return Some(wdl);
+        }
+
         // Safety: The `Board` should always be valid (a prerequisite for this library to work at all).
         // In order to call this function, a reference to `self` is required, which means the
         // tablebase must have been initialized. Hence it is be safe to call this.
         let result = unsafe {
             sys::tb_probe_wdl(
+                self.context.as_ptr(),
                 board.color_combined(Color::White).0,
                 board.color_combined(Color::Black).0,
                 board.pieces(Piece::King).0,
@@ -41,7 +43,65 @@ impl Tablebase {
             )
         };
 
-        Wdl::try_from(result).ok()
+        let wdl = Wdl::try_from(result).ok()?;
+        self.cache.store(key, wdl);
+        Some(wdl)
+    }
+
+    /// Probe the Win-Draw-Loss result of several positions at once.
+    ///
+    /// The results are the same as calling [`Tablebase::probe_wdl`] for each position with a
+    /// half-move clock of zero, in the same order. Positions that need to be read from the tables
+    /// are probed as one batch, where the table blocks for all of them are prefetched before any
+    /// are decoded. This hides much of the latency of tables that are not resident in memory.
+    ///
+    /// # Panics
+    /// Panics if more than `u32::MAX` positions need to be read from the tables.
+    ///
+    /// # Safety
+    /// While not marked as `unsafe`, this function's result is undefined if any board does not
+    /// represent a valid position.
+    #[must_use]
+    pub fn probe_wdl_many(&self, boards: &[Board]) -> Vec<Option<Wdl>> {
+        let mut results = vec![None; boards.len()];
+        let mut batch = Vec::new();
+        let mut batch_indices = Vec::new();
+
+        for (i, board) in boards.iter().enumerate() {
+            if !self.may_contain(board) {
+                continue;
+            }
+            if let Some(wdl) = self.cache.probe(board.get_hash()) {
+                results[i] = Some(wdl);
+                continue;
+            }
+            batch.push(tb_position(board));
+            batch_indices.push(i);
+        }
+
+        if batch.is_empty() {
+            return results;
+        }
+
+        let mut batch_results = vec![sys::TB_RESULT_FAILED; batch.len()];
+        // Safety: As for `probe_wdl`, and both arrays hold `batch.len()` elements.
+        unsafe {
+            sys::tb_probe_wdl_batch(
+                self.context.as_ptr(),
+                batch.as_ptr(),
+                u32::try_from(batch.len()).expect("batch should fit in a u32"),
+                batch_results.as_mut_ptr(),
+            );
+        }
+
+        for (i, result) in batch_indices.into_iter().zip(batch_results) {
+            results[i] = Wdl::try_from(result).ok();
+            if let Some(wdl) = results[i] {
+                self.cache.store(boards[i].get_hash(), wdl);
+            }
+        }
+
+        results
     }
 
     /// Probe the Distance-To-Zero result of the given position, and return a move filter.
@@ -49,41 +109,72 @@ impl Tablebase {
     /// If the position is in the tablebase, the returned move filter will evaluate to `true` only
     /// for moves that preserve the WDL result of the position.
     ///
-    ///
     /// # Safety
     /// While not marked as `unsafe`, this function's result is undefined if the board does not
-    /// represent a valid position. It is also _not_ thread-safe.
-    ///
-    /// TODO: Make this non-thread safety compiler enforced.
+    /// represent a valid position.
     #[must_use]
     pub fn probe_dtz(
         &self,
         board: &Board,
         halfmove_clock: usize,
     ) -> Option<(Wdl, impl Fn(&ChessMove) -> bool)> {
-        if board.castle_rights(Color::White) != CastleRights::NoRights
-            || board.castle_rights(Color::Black) != CastleRights::NoRights
-            || (board.color_combined(Color::White) | board.color_combined(Color::Black)).popcnt()
-                > self.max_pieces
-        {
+        self.probe_dtz_parallel(board, halfmove_clock, 1)
+    }
+
+    /// As [`Tablebase::probe_dtz`], but with the root moves probed on up to `threads` threads.
+    ///
+    /// Probing the root probes every move, each of which may need a table to be read from disk.
+    /// Splitting the moves over several threads overlaps that work, which matters when the
+    /// tables are not resident in memory. The result is the same for any number of threads.
+    ///
+    /// # Safety
+    /// While not marked as `unsafe`, this function's result is undefined if the board does not
+    /// represent a valid position.
+    #[must_use]
+    pub fn probe_dtz_parallel(
+        &self,
+        board: &Board,
+        halfmove_clock: usize,
+        threads: usize,
+    ) -> Option<(Wdl, impl Fn(&ChessMove) -> bool)> {
+        if !self.may_contain(board) {
             return None;
         }
 
-        let mut results_per_move = [0u32; sys::TB_MAX_MOVES as usize];
+        let mut probe = sys::TbRootProbe {
+            pos: tb_position(board),
+            rule50: u32::try_from(halfmove_clock).ok()?,
+            dtz: 0,
+            num_moves: 0,
+            moves: [0; sys::TB_MAX_MOVES as usize],
+        };
+
+        // Safety: As for `probe_wdl`, and the position has no castling rights.
+        if !unsafe { sys::tb_probe_root_begin(self.context.as_ptr(), &raw mut probe) } {
+            return None;
+        }
 
+        let mut scores = vec![0i16; probe.num_moves as usize];
+        let chunk_size = scores.len().div_ceil(threads.max(1)).max(1);
+        std::thread::scope(|s| {
+            let probe = &probe;
+            let mut chunks = scores.chunks_mut(chunk_size).enumerate();
+            let first = chunks.next();
+            for (i, chunk) in chunks {
+                s.spawn(move || self.score_root_moves(probe, i * chunk_size, chunk));
+            }
+            if let Some((_, chunk)) = first {
+                self.score_root_moves(probe, 0, chunk);
+            }
+        });
+
+        let mut results_per_move = [0u32; sys::TB_MAX_MOVES as usize];
+        // Safety: `scores` holds the scores of all moves, and `results_per_move` is large enough.
         let result = unsafe {
-            sys::tb_probe_root(
-                board.color_combined(Color::White).0,
-                board.color_combined(Color::Black).0,
-                board.pieces(Piece::King).0,
-                board.pieces(Piece::Queen).0,
-                board.pieces(Piece::Rook).0,
-                board.pieces(Piece::Bishop).0,
-                board.pieces(Piece::Knight).0,
-                board.pieces(Piece::Pawn).0,
-                u32::try_from(halfmove_clock).ok()?,
-                ep_to_fathom(board),
-                u8::from(board.side_to_move() == Color::White),
+            sys::tb_probe_root_end(
+                self.context.as_ptr(),
+                &raw const probe,
+                scores.as_ptr(),
                 results_per_move.as_mut_ptr(),
             )
         };
@@ -128,6 +219,48 @@ impl Tablebase {
 
         Some((wdl, move_filter))
     }
+
+    /// Score the root moves starting at `first`, one for each element of `scores`.
+    fn score_root_moves(&self, probe: &sys::TbRootProbe, first: usize, scores: &mut [i16]) {
+        // Safety: The probe was started by `tb_probe_root_begin`, and the range is within its
+        // moves. Scoring disjoint ranges from several threads is allowed.
+        unsafe {
+            sys::tb_probe_root_score(
+                self.context.as_ptr(),
+                probe,
+                u32::try_from(first).expect("at most TB_MAX_MOVES moves"),
+                u32::try_from(scores.len()).expect("at most TB_MAX_MOVES moves"),
+                scores.as_mut_ptr(),
+            );
+        }
+    }
+
+    /// Return `true` if the position can be in the tablebase, i.e. it has no castling rights and
+    /// few enough pieces.
+    #[inline]
+    fn may_contain(&self, board: &Board) -> bool {
+        board.castle_rights(Color::White) == CastleRights::NoRights
+            && board.castle_rights(Color::Black) == CastleRights::NoRights
+            && (board.color_combined(Color::White) | board.color_combined(Color::Black)).popcnt()
+                <= self.max_pieces
+    }
+}
+
+/// Return the position as fathom expects it.
+#[inline]
+fn tb_position(board: &Board) -> sys::TbPosition {
+    sys::TbPosition {
+        white: board.color_combined(Color::White).0,
+        black: board.color_combined(Color::Black).0,
+        kings: board.pieces(Piece::King).0,
+        queens: board.pieces(Piece::Queen).0,
+        rooks: board.pieces(Piece::Rook).0,
+        bishops: board.pieces(Piece::Bishop).0,
+        knights: board.pieces(Piece::Knight).0,
+        pawns: board.pieces(Piece::Pawn).0,
+        ep: ep_to_fathom(board),
+        turn: board.side_to_move() == Color::White,
+    }
 }
 
 /// Return the representation of the boards en passant square (if any) that fathom expects.
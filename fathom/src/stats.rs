@@ -0,0 +1,92 @@
+//! Probe statistics, see [`Tablebase::stats`](super::Tablebase::stats).
+use std::time::Duration;
+
+use super::sys;
+
+/// Probe statistics of a tablebase.
+///
+/// Probes answered from the WDL result cache never reach the tables, and are not counted.
+#[derive(Debug, Clone, Default)]
+pub struct Stats {
+    /// WDL probes of the tables.
+    pub wdl_probes: u64,
+    /// WDL probes that failed, e.g. because a table was missing.
+    pub wdl_failures: u64,
+    /// Root (DTZ) probes of the tables.
+    pub root_probes: u64,
+    /// Root probes that failed.
+    pub root_failures: u64,
+    /// The tables that have been loaded or probed, most probed first.
+    pub tables: Vec<TableStats>,
+}
+
+/// Probe statistics of one material table.
+#[derive(Debug, Clone, Default)]
+pub struct TableStats {
+    /// The material, e.g. `KRPvKR`.
+    pub name: String,
+    /// Statistics of the WDL file.
+    pub wdl: FileStats,
+    /// Statistics of the DTZ file.
+    pub dtz: FileStats,
+}
+
+/// Probe statistics of one table file.
+#[derive(Debug, Clone, Copy, Default)]
+pub struct FileStats {
+    /// Lookups of a position in the file, including those made while resolving captures.
+    pub probes: u64,
+    /// Compressed blocks decoded.
+    pub blocks: u64,
+    /// Total size of the blocks decoded in bytes.
+    pub bytes: u64,
+    /// Time taken to open and map the file, or `None` if it has not been loaded.
+    pub init_time: Option<Duration>,
+}
+
+impl Stats {
+    pub(crate) fn new(stats: &sys::TbStats, tables: &[sys::TbTableStats]) -> Self {
+        let mut tables = tables
+            .iter()
+            .map(TableStats::from)
+            .filter(|table| {
+                table.wdl.probes + table.dtz.probes > 0
+                    || table.wdl.init_time.is_some()
+                    || table.dtz.init_time.is_some()
+            })
+            .collect::<Vec<_>>();
+        tables.sort_by_key(|table| std::cmp::Reverse(table.wdl.probes + table.dtz.probes));
+
+        Self {
+            wdl_probes: stats.wdl_probes,
+            wdl_failures: stats.wdl_failures,
+            root_probes: stats.root_probes,
+            root_failures: stats.root_failures,
+            tables,
+        }
+    }
+}
+
+impl From<&sys::TbTableStats> for TableStats {
+    fn from(stats: &sys::TbTableStats) -> Self {
+        // Safety: The name is a nul-terminated string written by the C library.
+        let name = unsafe { std::ffi::CStr::from_ptr(stats.name.as_ptr()) };
+        Self {
+            name: name.to_string_lossy().into_owned(),
+            wdl: FileStats::new(stats, sys::TB_STATS_WDL),
+            dtz: FileStats::new(stats, sys::TB_STATS_DTZ),
+        }
+    }
+}
+
+impl FileStats {
+    fn new(stats: &sys::TbTableStats, file: usize) -> Self {
+        Self {
+            probes: stats.probes[file],
+            blocks: stats.blocks[file],
+            bytes: stats.bytes[file],
+            init_time: (stats.init_nanos[file] > 0)
+                .then(|| Duration::from_nanos(stats.init_nanos[file])),
+        }
+    }
+}
@@ -25,11 +25,77 @@ pub const TB_RESULT_FAILED: u32 = 0xFFFF_FFFF;
 
 pub const TB_MAX_MOVES: u32 = 192 + 1;
 
+pub const TB_PRELOAD_DTZ: u32 = 0x1;
+pub const TB_PRELOAD_LOCK: u32 = 0x2;
+
+/// A position for [`tb_probe_wdl_batch`], with the same fields as the arguments of
+/// [`tb_probe_wdl`].
+#[repr(C)]
+#[derive(Debug, Clone, Copy)]
+pub struct TbPosition {
+    pub white: u64,
+    pub black: u64,
+    pub kings: u64,
+    pub queens: u64,
+    pub rooks: u64,
+    pub bishops: u64,
+    pub knights: u64,
+    pub pawns: u64,
+    pub ep: u32,
+    pub turn: bool,
+}
+
+/// The state of a root probe split over several calls, see [`tb_probe_root_begin`].
+#[repr(C)]
+#[derive(Debug, Clone, Copy)]
+pub struct TbRootProbe {
+    pub pos: TbPosition,
+    pub rule50: u32,
+    pub dtz: i32,
+    pub num_moves: u32,
+    pub moves: [u16; TB_MAX_MOVES as usize],
+}
+
+pub const TB_STATS_WDL: usize = 0;
+pub const TB_STATS_DTZ: usize = 2;
+
+/// Probe statistics of a context, see [`tb_context_stats`].
+#[repr(C)]
+#[derive(Debug, Clone, Copy, Default)]
+pub struct TbStats {
+    pub wdl_probes: u64,
+    pub wdl_failures: u64,
+    pub root_probes: u64,
+    pub root_failures: u64,
+}
+
+/// Probe statistics of one table, indexed by [`TB_STATS_WDL`] and [`TB_STATS_DTZ`] (and DTM,
+/// which is not used here) for the table files.
+#[repr(C)]
+#[derive(Debug, Clone, Copy, Default)]
+pub struct TbTableStats {
+    pub name: [std::ffi::c_char; 16],
+    pub probes: [u64; 3],
+    pub blocks: [u64; 3],
+    pub bytes: [u64; 3],
+    pub init_nanos: [u64; 3],
+}
+
+/// Opaque handle to a set of loaded tablebase files, owned by the C library.
+///
+/// Created by [`tb_context_new`] and released with [`tb_context_free`].
+#[repr(C)]
+pub struct TbContext {
+    _opaque: [u8; 0],
+}
+
 /// Probe the Win-Draw-Loss (WDL) table.
 ///
 /// Important: Only positions without castling rights and with a rule50 of 0 are supported.
 ///
 /// # Arguments
+/// - ctx:
+///   The tablebase context.
 /// - white, black, kings, queens, rooks, bishops, knights, pawns:
 ///   The current position (bitboards).
 /// - rule50:
@@ -50,11 +116,12 @@ pub const TB_MAX_MOVES: u32 = 192 + 1;
 /// - This function is thread safe.
 ///
 /// # Safety
-/// This assumes that `tb_init` has been called sucessfully, and that
+/// This assumes that `ctx` was returned by [`tb_context_new`] and has not been freed, and that
 /// the arguments describe a valid position. Otherwise this is undefined.
 #[allow(clippy::too_many_arguments)]
 #[inline]
 pub unsafe fn tb_probe_wdl(
+    ctx: *mut TbContext,
     white: u64,
     black: u64,
     kings: u64,
@@ -69,74 +136,7 @@ pub unsafe fn tb_probe_wdl(
     // SAFETY: Caller has ensured the pre-conditions hold.
     unsafe {
         tb_probe_wdl_impl(
-            white, black, kings, queens, rooks, bishops, knights, pawns, ep, turn,
-        )
-    }
-}
-
-/// Probe the Distance-To-Zero (DTZ) table.
-///
-/// # Arguments
-/// - white, black, kings, queens, rooks, bishops, knights, pawns:
-///   The current position (bitboards).
-/// - rule50:
-///   The 50-move half-move clock.
-/// - castling:
-///   Castling rights.  Set to zero if no castling is possible.
-/// - ep:
-///   The en passant square (if exists).  Set to zero if there is no en passant square.
-/// - turn:
-///   true=white, false=black
-/// - results (OPTIONAL):
-///   Alternative results, one for each possible legal move.  The passed array must be [`TB_MAX_MOVES`]
-///   in size. If alternative results are not desired then set results=NULL.
-///
-/// # Return
-/// A [`TB_RESULT`] value comprising:
-/// 1) The WDL value ([`TB_GET_WDL`])
-/// 2) The suggested move ([`TB_GET_FROM`], [`TB_GET_TO`], [`TB_GET_PROMOTES`], [`TB_GET_EP`])
-/// 3) The DTZ value ([`TB_GET_DTZ`])
-///
-/// The suggested move is guaranteed to preserved the WDL value.
-///
-/// Otherwise:
-/// 1) [`TB_RESULT_STALEMATE`] is returned if the position is in stalemate.
-/// 2) [`TB_RESULT_CHECKMATE`] is returned if the position is in checkmate.
-/// 3) [`TB_RESULT_FAILED`] is returned if the probe failed.
-///
-/// If results!=NULL, then a [`TB_RESULT`] for each legal move will be generated
-/// and stored in the results array.  The results array will be terminated
-/// by [`TB_RESULT_FAILED`].
-///
-/// # Notes
-/// - Engines can use this function to probe at the root.  This function should not be used during search.
-/// - DTZ tablebases can suggest unnatural moves, especially for losing positions.  Engines may prefer to
-///   traditional search combined with WDL move filtering using the alternative results array.
-/// - This function is NOT thread safe. For engines this function should only be called once at the
-///   root per search.
-///
-/// # Safety
-/// This assumes that `tb_init` has been called sucessfully, and that the arguments describe a valid
-/// position. It also assumes that no other thread is calling this function at the same time.
-#[allow(clippy::too_many_arguments)]
-pub unsafe fn tb_probe_root(
-    white: u64,
-    black: u64,
-    kings: u64,
-    queens: u64,
-    rooks: u64,
-    bishops: u64,
-    knights: u64,
-    pawns: u64,
-    rule50: u32,
-    ep: u32,
-    turn: u8,
-    results: *mut u32,
-) -> u32 {
-    // SAFETY: Caller has ensured the pre-conditions hold.
-    unsafe {
-        tb_probe_root_impl(
-            white, black, kings, queens, rooks, bishops, knights, pawns, rule50, ep, turn, results,
+            ctx, white, black, kings, queens, rooks, bishops, knights, pawns, ep, turn,
         )
     }
 }
@@ -156,11 +156,46 @@ pub const fn tb_get_promotes(res: u32) -> u32 {
 }
 
 unsafe extern "C" {
-    pub static TB_LARGEST: u32;
+    /// Load the tablebase files found on `path`.
+    ///
+    /// Returns a null pointer if the context could not be allocated. If no files are found, a
+    /// valid context is still returned, and [`tb_context_largest`] returns zero for it.
+    pub fn tb_context_new(path: *const std::ffi::c_char) -> *mut TbContext;
+
+    /// Release a context and everything it has mapped into memory.
+    ///
+    /// No probe of the context may be in progress, and the context must not be used afterwards.
+    pub fn tb_context_free(ctx: *mut TbContext);
+
+    /// The largest number of pieces that the context holds tables for.
+    pub fn tb_context_largest(ctx: *const TbContext) -> u32;
 
-    pub fn tb_init(filename: *const std::ffi::c_char) -> bool;
+    /// Initialize tables up front and read them into memory.
+    ///
+    /// WDL tables are loaded before DTZ tables (only with [`TB_PRELOAD_DTZ`]), smaller before
+    /// larger, skipping tables that don't fit in what is left of `budget` bytes (zero for no
+    /// limit). With [`TB_PRELOAD_LOCK`], the tables are also locked in memory. Returns the number
+    /// of bytes preloaded.
+    pub fn tb_context_preload(ctx: *mut TbContext, budget: u64, flags: u32) -> u64;
+
+    /// Unlock all tables locked by [`tb_context_preload`], so that they can be paged out again.
+    pub fn tb_context_unlock(ctx: *mut TbContext);
+
+    /// Enable or disable collecting probe statistics. Enabling them resets all counters.
+    pub fn tb_context_set_stats(ctx: *mut TbContext, enable: bool);
+
+    /// Read the probe statistics of the context, and of up to `max` of its tables into `tables`.
+    ///
+    /// Returns the number of tables in the context, which may be more than `max`.
+    pub fn tb_context_stats(
+        ctx: *const TbContext,
+        stats: *mut TbStats,
+        tables: *mut TbTableStats,
+        max: u32,
+    ) -> u32;
 
     fn tb_probe_wdl_impl(
+        ctx: *mut TbContext,
         white: u64,
         black: u64,
         kings: u64,
@@ -173,18 +208,59 @@ unsafe extern "C" {
         turn: u8,
     ) -> u32;
 
-    fn tb_probe_root_impl(
-        white: u64,
-        black: u64,
-        kings: u64,
-        queens: u64,
-        rooks: u64,
-        bishops: u64,
-        knights: u64,
-        pawns: u64,
-        rule50: u32,
-        ep: u32,
-        turn: u8,
+    /// Probe the Win-Draw-Loss (WDL) table for several positions at once.
+    ///
+    /// The results, stored in `results` (which must hold `n` values), are the same as calling
+    /// [`tb_probe_wdl`] for each position. The table blocks for all positions are prefetched before
+    /// any are decoded, so that page faults on tables not resident in memory overlap.
+    pub fn tb_probe_wdl_batch(
+        ctx: *mut TbContext,
+        positions: *const TbPosition,
+        n: u32,
+        results: *mut u32,
+    );
+
+    /// Start probing the Distance-To-Zero (DTZ) table at the root.
+    ///
+    /// The caller fills in `pos` and `rule50` of `rp`, and this sets the other fields. Returns
+    /// `false` if the probe failed, in which case the other root probe functions must not be called.
+    /// Castling rights are not checked, so the position must have none.
+    pub fn tb_probe_root_begin(ctx: *mut TbContext, rp: *mut TbRootProbe) -> bool;
+
+    /// Score the moves `rp.moves[first..first + count]`, storing the scores in `scores`.
+    ///
+    /// This is the bulk of a root probe, and may be called from several threads at once for
+    /// disjoint ranges of moves.
+    pub fn tb_probe_root_score(
+        ctx: *mut TbContext,
+        rp: *const TbRootProbe,
+        first: u32,
+        count: u32,
+        scores: *mut i16,
+    );
+
+    /// Finish a root probe, given the scores of all `rp.num_moves` moves.
+    ///
+    /// # Return
+    /// A [`TB_RESULT`] value comprising:
+    /// 1) The WDL value ([`TB_GET_WDL`])
+    /// 2) The suggested move ([`TB_GET_FROM`], [`TB_GET_TO`], [`TB_GET_PROMOTES`], [`TB_GET_EP`])
+    /// 3) The DTZ value ([`TB_GET_DTZ`])
+    ///
+    /// The suggested move is guaranteed to preserved the WDL value.
+    ///
+    /// Otherwise:
+    /// 1) [`TB_RESULT_STALEMATE`] is returned if the position is in stalemate.
+    /// 2) [`TB_RESULT_CHECKMATE`] is returned if the position is in checkmate.
+    /// 3) [`TB_RESULT_FAILED`] is returned if the probe failed.
+    ///
+    /// If results!=NULL, then a [`TB_RESULT`] for each legal move will be generated
+    /// and stored in the results array, which must be [`TB_MAX_MOVES`] in size.  The results array
+    /// will be terminated by [`TB_RESULT_FAILED`].
+    pub fn tb_probe_root_end(
+        ctx: *mut TbContext,
+        rp: *const TbRootProbe,
+        scores: *const i16,
         results: *mut u32,
     ) -> u32;
 }
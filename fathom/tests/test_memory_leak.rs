@@ -1,36 +1,44 @@
 //! # Memory leak tests
 //!
 //! ## Why?
-//! The fathom library is a little strange with how it deals with freeing memory.
+//! Every [`fathom::Tablebase`] owns a separate context in the C library, which maps the table
+//! files into memory and allocates decoding tables for them as they are probed. Dropping the
+//! tablebase must release all of it, otherwise reloading the tablebase (e.g. when the
+//! `SyzygyPath` option changes on a running engine) would leak.
 //!
-//! Calling `tb_init`, `tb_free`, `tb_init`, `tb_free` in that sequence triggers a memory
-//! corruption. See [this POC][bug-poc] using the `fathom-syzygy` crate. That crate does many
-//! things on top of fathom, but the issue resides in fathom itself.
+//! Upstream fathom used process-global state, where calling `tb_init`, `tb_free`, `tb_init`,
+//! `tb_free` in that sequence triggered a memory corruption. See [this POC][bug-poc] using the
+//! `fathom-syzygy` crate. The contexts don't share anything, so that sequence is now simply
+//! creating and dropping tablebases.
 //!
-//! ## Solution
-//! This crate treats this issue with the following solution: Don't call `tb_free`.
-//!
-//! ## Wait, what?
-//! Yes, that's right. This crate doesn't even link against the `tb_free` function. This isn't as
-//! bad as it sounds, though. This is because fathom is strange, and `tb_init` actually calls free
-//! on the things it reinitializes.
-//!
-//! This test is about verifying that hypothesis.
-//!
-//! I have run this test with a _lot_ of iterations, and not seen any change in the programs memory
-//! usage during or after that time. The test is ignored by default, as it is very slow.
+//! This test loads, probes and drops a tablebase many times, and should be run while observing
+//! the memory usage of the process (or under a leak checker). The test is ignored by default, as
+//! it is very slow.
 //!
 //! [bug-poc]: https://github.com/malu/fathom-syzygy/commit/1a35239920424ed321ccea8906ccbacb36f7b77f
 
 #[test]
 #[ignore = "takes a while to run"]
 fn test_memory_leaks() {
+    let board: chess::Board = "8/8/8/8/5kp1/P7/8/1K1N4 w - - 0 1".parse().unwrap();
     for _ in 0..100_000 {
-        let ownership =
-            fathom::Tablebase::acquire().expect("should be able to aquire ownership during test");
         let table =
-            fathom::Tablebase::load(ownership, concat!(env!("CARGO_MANIFEST_DIR"), "/../syzygy"))
+            fathom::Tablebase::load(concat!(env!("CARGO_MANIFEST_DIR"), "/../syzygy"))
                 .expect("should be able to load table base in memory leak test");
+        assert!(table.probe_wdl(&board, 0).is_some());
         std::hint::black_box(table);
     }
 }
+
+#[test]
+#[ignore = "takes a while to run"]
+fn test_concurrent_tablebases() {
+    let board: chess::Board = "8/8/8/8/5kp1/P7/8/1K1N4 w - - 0 1".parse().unwrap();
+    let first = fathom::Tablebase::load(concat!(env!("CARGO_MANIFEST_DIR"), "/../syzygy"))
+        .expect("should be able to load the first table base");
+    let second = fathom::Tablebase::load(concat!(env!("CARGO_MANIFEST_DIR"), "/../syzygy"))
+        .expect("should be able to load a second table base alongside the first");
+    assert_eq!(first.probe_wdl(&board, 0), second.probe_wdl(&board, 0));
+    drop(first);
+    assert_eq!(second.probe_wdl(&board, 0), Some(fathom::Wdl::Win));
+}
@@ -4,10 +4,8 @@ use chess::{Board, ChessMove, MoveGen};
 
 use fathom::{Tablebase, Wdl};
 
-static TB: LazyLock<Tablebase> = LazyLock::new(|| {
-    let ownership = Tablebase::acquire().expect("should be able to aquire during test");
-    Tablebase::load(ownership, concat!(env!("CARGO_MANIFEST_DIR"), "/../syzygy")).unwrap()
-});
+static TB: LazyLock<Tablebase> =
+    LazyLock::new(|| Tablebase::load(concat!(env!("CARGO_MANIFEST_DIR"), "/../syzygy")).unwrap());
 
 fn test(
     fen: &str,
@@ -38,6 +36,18 @@ fn test(
         }
         assert!(moves.contains(m));
     }
+
+    // Probing the moves on several threads must give the same result.
+    for threads in [2, 4, 64] {
+        let (wdl, filter) = TB
+            .probe_dtz_parallel(&board, halfmove_clock, threads)
+            .unwrap();
+        assert_eq!(wdl, expected_wdl);
+        let parallel_moves = MoveGen::new_legal(&board)
+            .filter(|mv| filter(mv))
+            .collect::<Vec<_>>();
+        assert_eq!(parallel_moves, moves);
+    }
     Ok(())
 }
 
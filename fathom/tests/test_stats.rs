@@ -0,0 +1,68 @@
+use chess::Board;
+
+use fathom::Tablebase;
+
+fn load() -> Tablebase {
+    Tablebase::load(concat!(env!("CARGO_MANIFEST_DIR"), "/../syzygy")).unwrap()
+}
+
+#[test]
+fn stats_are_disabled_by_default() {
+    let tb = load();
+    let board: Board = "8/8/8/8/5kp1/P7/8/1K1N4 w - - 0 1".parse().unwrap();
+    assert!(tb.probe_wdl(&board, 0).is_some());
+
+    let stats = tb.stats();
+    assert_eq!(stats.wdl_probes, 0);
+    // The load time is recorded regardless.
+    let table = stats.tables.iter().find(|t| t.name == "KNPvKP").unwrap();
+    assert_eq!(table.wdl.probes, 0);
+    assert!(table.wdl.init_time.is_some());
+}
+
+#[test]
+fn stats_start_at_zero_after_reload() {
+    // Use a context, so that the next one may reuse its memory.
+    let tb = load();
+    tb.set_stats_enabled(true);
+    let board: Board = "8/8/8/8/5kp1/P7/8/1K1N4 w - - 0 1".parse().unwrap();
+    assert!(tb.probe_dtz(&board, 0).is_some());
+    assert!(!tb.stats().tables.is_empty());
+    drop(tb);
+
+    let tb = load();
+    let stats = tb.stats();
+    assert_eq!(stats.wdl_probes, 0);
+    assert_eq!(stats.root_probes, 0);
+    assert!(stats.tables.is_empty());
+
+    tb.set_stats_enabled(true);
+    assert!(tb.stats().tables.is_empty());
+}
+
+#[test]
+fn stats_count_probes_per_table() {
+    let tb = load();
+    tb.set_stats_enabled(true);
+
+    let board: Board = "8/8/8/8/5kp1/P7/8/1K1N4 w - - 0 1".parse().unwrap();
+    for _ in 0..3 {
+        assert!(tb.probe_wdl(&board, 0).is_some());
+    }
+    assert!(tb.probe_dtz(&board, 0).is_some());
+
+    let stats = tb.stats();
+    assert_eq!(stats.wdl_probes, 3);
+    assert_eq!(stats.wdl_failures, 0);
+    assert_eq!(stats.root_probes, 1);
+    assert_eq!(stats.root_failures, 0);
+
+    let table = stats.tables.iter().find(|t| t.name == "KNPvKP").unwrap();
+    assert!(table.wdl.probes >= 3);
+    assert!(table.wdl.blocks <= table.wdl.probes);
+    assert!(table.dtz.probes >= 1);
+    assert!(table.dtz.init_time.is_some());
+
+    tb.set_stats_enabled(true);
+    assert_eq!(tb.stats().wdl_probes, 0);
+}
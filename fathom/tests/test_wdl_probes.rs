@@ -4,16 +4,34 @@ use chess::Board;
 
 use fathom::{Tablebase, Wdl};
 
-static TB: LazyLock<Tablebase> = LazyLock::new(|| {
-    let ownership = Tablebase::acquire().expect("should be able to aquire during test");
-    Tablebase::load(ownership, concat!(env!("CARGO_MANIFEST_DIR"), "/../syzygy")).unwrap()
-});
+static TB: LazyLock<Tablebase> =
+    LazyLock::new(|| Tablebase::load(concat!(env!("CARGO_MANIFEST_DIR"), "/../syzygy")).unwrap());
 
 fn test(fen: &str, expected_wdl: Wdl) {
     let board: Board = fen.parse().unwrap();
     let wdl = TB.probe_wdl(&board, 0).unwrap();
 
     assert_eq!(wdl, expected_wdl);
+    assert_eq!(TB.probe_wdl_many(&[board]), vec![Some(expected_wdl)]);
+}
+
+#[test]
+fn batch_matches_single_probes() {
+    let boards: Vec<Board> = [
+        "8/8/8/8/5kp1/P7/8/1K1N4 w - - 0 1",
+        "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+        "8/3k4/8/8/8/4B3/4KB2/2B5 w - - 0 1",
+        "8/6B1/8/8/B7/8/K1pk4/8 b - - 0 1",
+        "8/8/8/k1pPp3/8/K7/8/8 w - c6 0 1",
+        "8/8/8/k1pPp3/8/K7/8/8 w - e6 0 1",
+    ]
+    .iter()
+    .map(|fen| fen.parse().unwrap())
+    .collect();
+
+    let expected: Vec<_> = boards.iter().map(|b| TB.probe_wdl(b, 0)).collect();
+    assert_eq!(expected[1], None);
+    assert_eq!(TB.probe_wdl_many(&boards), expected);
 }
 
 macro_rules! test_wdl_probe {
@@ -10,7 +10,7 @@ pub struct Position {
 #[derive(Debug)]
 pub enum Command {
     Uci,
-    Debug,
+    Debug(bool),
     IsReady,
     SetOption(EngineOption),
     UciNewGame,
@@ -62,7 +62,11 @@ impl std::str::FromStr for Command {
         let (command, rest) = s.split_once(' ').unwrap_or((s, ""));
         match command {
             "uci" => Ok(Command::Uci),
-            "debug" => Ok(Command::Debug),
+            "debug" => match rest.trim() {
+                "on" => Ok(Command::Debug(true)),
+                "off" => Ok(Command::Debug(false)),
+                _ => Err(format!("Invalid debug command: {s}")),
+            },
             "isready" => Ok(Command::IsReady),
             "setoption" => Ok(Command::SetOption(rest.parse()?)),
             "ucinewgame" => Ok(Command::UciNewGame),
@@ -53,7 +53,7 @@ while let Ok(cmd) = interface.commands.recv() {
         uci::Command::Stop => todo!(),
         uci::Command::Quit => todo!(),
         uci::Command::PonderHit => todo!(),
-        uci::Command::Debug => todo!(),
+        uci::Command::Debug(_) => todo!(),
         uci::Command::Unknown(e) => eprintln!("{e}"),
     }
 }
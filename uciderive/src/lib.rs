@@ -22,6 +22,7 @@ struct UciOptionAttrubute {
 enum UciOptionType {
     String,
     Spin,
+    Check,
 }
 
 #[derive(Debug, FromDeriveInput)]
@@ -125,6 +126,7 @@ fn impl_print_options(fields: &Fields<UciOptionAttrubute>) -> proc_macro2::Token
         let kind = match kind {
             UciOptionType::String => "string",
             UciOptionType::Spin => "spin",
+            UciOptionType::Check => "check",
         };
         let min = min.clone().map(|min| min.value());
         let max = max.clone().map(|max| max.value());